@@ -29,6 +29,8 @@
 #include <X11/Xproto.h>
 #include <X11/extensions/XTest.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
 #include "sdorfehs.h"
 
@@ -106,17 +108,26 @@ typedef struct {
 	char *alias;
 } alias_t;
 
+/* A saved frameset of a vscreen. */
 typedef struct rp_frame_undo {
-	char *frames;
 	rp_vscreen *vscreen;
-	struct list_head node;
+	struct rp_frame_snapshot **frames;
+	int nframes;
 } rp_frame_undo;
 
+/*
+ * The most recent maxundos framesets, newest at top, oldest overwritten
+ * first.
+ */
+struct frame_undo_ring {
+	rp_frame_undo *entries;
+	int size, top, count;
+};
+
 static LIST_HEAD(user_commands);
 static LIST_HEAD(rp_keymaps);
 static LIST_HEAD(set_vars);
-static LIST_HEAD(rp_frame_undos);
-static LIST_HEAD(rp_frame_redos);
+static struct frame_undo_ring frame_undos, frame_redos;
 
 static alias_t *alias_list;
 static int alias_list_size;
@@ -124,11 +135,28 @@ static int alias_list_last;
 
 static const char invalid_negative_arg[] = "invalid negative argument";
 
+/*
+ * A keybinding's command with its user_command looked up and its arguments
+ * parsed when it is bound, so pressing the key doesn't have to.  It is
+ * reference counted since the command may rebind its own key.
+ */
+struct compiled_action {
+	struct user_command *uc;
+	struct cmdarg **args;
+	int refs;
+};
+
+static void compile_action(rp_action *action);
+static void compile_keymaps(void);
+static void release_compiled_action(struct compiled_action *ca);
+static cmdret *parse_keydesc(char *keydesc, struct rp_key *key);
+
 /* setter function prototypes */
 static cmdret *set_barborder(struct cmdarg **args);
 static cmdret *set_barbordercolor(struct cmdarg **args);
 static cmdret *set_bargravity(struct cmdarg **args);
 static cmdret *set_barinpadding(struct cmdarg **args);
+static cmdret *set_barmaxfps(struct cmdarg **args);
 static cmdret *set_barpadding(struct cmdarg **args);
 static cmdret *set_barsticky(struct cmdarg **args);
 static cmdret *set_bgcolor(struct cmdarg **args);
@@ -136,12 +164,14 @@ static cmdret *set_border(struct cmdarg **args);
 static cmdret *set_bwcolor(struct cmdarg **args);
 static cmdret *set_fgcolor(struct cmdarg **args);
 static cmdret *set_font(struct cmdarg **args);
+static cmdret *set_fontcachesize(struct cmdarg **args);
 static cmdret *set_framefmt(struct cmdarg **args);
 static cmdret *set_framemsgwait(struct cmdarg **args);
 static cmdret *set_framesels(struct cmdarg **args);
 static cmdret *set_fwcolor(struct cmdarg **args);
 static cmdret *set_gap(struct cmdarg **args);
 static cmdret *set_historysize(struct cmdarg **args);
+static cmdret *set_historycompaction(struct cmdarg **args);
 static cmdret *set_ignoreresizehints(struct cmdarg **args);
 static cmdret *set_infofmt(struct cmdarg **args);
 static cmdret *set_inputwidth(struct cmdarg **args);
@@ -275,6 +305,117 @@ static cmdret *cmd_vscreens(int interactive, struct cmdarg **args);
 static cmdret *cmd_vselect(int interactive, struct cmdarg **args);
 static cmdret *cmd_windows(int interactive, struct cmdarg **args);
 
+/*
+ * Aliases, commands, variables and hooks by name, in an open addressing hash
+ * table so looking them up doesn't mean walking every list with strcmp.  A
+ * name can be several of these at once, in which case the alias wins for
+ * command().  Entries are never removed, an unaliased name just drops its
+ * alias.
+ */
+struct symbol {
+	char *name;
+	int alias;		/* index into alias_list or -1 */
+	struct user_command *uc;
+	struct set_var *var;
+	struct list_head *hook;
+};
+
+static struct symbol *symbols;
+static unsigned int symbols_size;
+static unsigned int symbols_count;
+
+static unsigned int
+symbol_hash(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	/* FNV-1a */
+	for (; *name; name++)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+
+	return h;
+}
+
+static struct symbol *
+symbol_slot(struct symbol *table, unsigned int size, const char *name)
+{
+	unsigned int i;
+
+	for (i = symbol_hash(name) & (size - 1); table[i].name;
+	    i = (i + 1) & (size - 1)) {
+		if (strcmp(table[i].name, name) == 0)
+			break;
+	}
+
+	return &table[i];
+}
+
+/* Return the symbol called name, or NULL. */
+static struct symbol *
+symbol_find(const char *name)
+{
+	struct symbol *sym;
+
+	if (symbols == NULL)
+		return NULL;
+
+	sym = symbol_slot(symbols, symbols_size, name);
+	return sym->name ? sym : NULL;
+}
+
+/* Return the symbol called name, adding an empty one if needed. */
+static struct symbol *
+symbol_add(const char *name)
+{
+	struct symbol *old = symbols, *sym;
+	unsigned int i, size = symbols_size;
+
+	if ((sym = symbol_find(name)))
+		return sym;
+
+	/* Keep the table at most half full. */
+	if ((symbols_count + 1) * 2 > symbols_size) {
+		symbols_size = symbols_size ? symbols_size * 2 : 256;
+		symbols = xmalloc(sizeof(struct symbol) * symbols_size);
+		memset(symbols, 0, sizeof(struct symbol) * symbols_size);
+
+		for (i = 0; i < size; i++) {
+			if (old[i].name)
+				memcpy(symbol_slot(symbols, symbols_size,
+				    old[i].name), &old[i],
+				    sizeof(struct symbol));
+		}
+		free(old);
+	}
+
+	sym = symbol_slot(symbols, symbols_size, name);
+	sym->name = xstrdup(name);
+	sym->alias = -1;
+	symbols_count++;
+
+	return sym;
+}
+
+static void
+free_symbols(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < symbols_size; i++)
+		free(symbols[i].name);
+	free(symbols);
+	symbols = NULL;
+	symbols_size = symbols_count = 0;
+}
+
+static struct list_head *
+find_hook(char *str)
+{
+	struct symbol *sym = symbol_find(str);
+
+	return sym ? sym->hook : NULL;
+}
+
 static void
 add_set_var(char *name, cmdret *(*fn)(struct cmdarg **), int nargs, ...)
 {
@@ -297,6 +438,7 @@ add_set_var(char *name, cmdret *(*fn)(struct cmdarg **), int nargs, ...)
 	va_end(va);
 
 	list_add_tail(&var->node, &set_vars);
+	symbol_add(name)->var = var;
 }
 
 static void
@@ -317,6 +459,7 @@ init_set_vars(void)
 	add_set_var("barbordercolor", set_barbordercolor, 1, "", arg_STRING);
 	add_set_var("bargravity", set_bargravity, 1, "", arg_GRAVITY);
 	add_set_var("barinpadding", set_barinpadding, 1, "", arg_NUMBER);
+	add_set_var("barmaxfps", set_barmaxfps, 1, "", arg_NUMBER);
 	add_set_var("barpadding", set_barpadding, 2, "", arg_NUMBER, "",
 	    arg_NUMBER);
 	add_set_var("barsticky", set_barsticky, 1, "", arg_NUMBER);
@@ -325,11 +468,14 @@ init_set_vars(void)
 	add_set_var("bwcolor", set_bwcolor, 1, "", arg_STRING);
 	add_set_var("fgcolor", set_fgcolor, 1, "", arg_STRING);
 	add_set_var("font", set_font, 1, "", arg_STRING);
+	add_set_var("fontcachesize", set_fontcachesize, 1, "", arg_NUMBER);
 	add_set_var("framefmt", set_framefmt, 1, "", arg_REST);
 	add_set_var("framemsgwait", set_framemsgwait, 1, "", arg_NUMBER);
 	add_set_var("framesels", set_framesels, 1, "", arg_STRING);
 	add_set_var("fwcolor", set_fwcolor, 1, "", arg_STRING);
 	add_set_var("gap", set_gap, 1, "", arg_NUMBER);
+	add_set_var("historycompaction", set_historycompaction, 1, "",
+	    arg_NUMBER);
 	add_set_var("historysize", set_historysize, 1, "", arg_NUMBER);
 	add_set_var("ignoreresizehints", set_ignoreresizehints, 1, "",
 	    arg_NUMBER);
@@ -387,6 +533,7 @@ add_command(char *name, cmdret *(*fn)(int, struct cmdarg **), int nargs,
 	va_end(va);
 
 	list_add(&cmd->node, &user_commands);
+	symbol_add(name)->uc = cmd;
 }
 
 static void
@@ -402,6 +549,8 @@ user_command_free(struct user_command *cmd)
 void
 init_user_commands(void)
 {
+	struct rp_hook_db_entry *entry;
+
 	/* @begin (tag required for genrpbindings) */
 	add_command("abort",		cmd_abort,	0, 0, 0);
 	add_command("addhook",		cmd_addhook,	2, 2, 2,
@@ -586,143 +735,313 @@ init_user_commands(void)
 	/* @end (tag required for genrpbindings) */
 
 	init_set_vars();
+
+	for (entry = rp_hook_db; entry->name; entry++)
+		symbol_add(entry->name)->hook = entry->hook;
 }
 
-/* Delete all entries in the redo list. */
 static void
-clear_frame_redos(void)
+frame_undo_free(rp_frame_undo *u)
 {
-	rp_frame_undo *cur;
-	struct list_head *tmp, *iter;
+	int i;
 
-	list_for_each_safe_entry(cur, iter, tmp, &rp_frame_redos, node) {
-		free(cur->frames);
-		list_del(&(cur->node));
+	for (i = 0; i < u->nframes; i++)
+		frame_snapshot_free(u->frames[i]);
+	free(u->frames);
+	u->frames = NULL;
+	u->nframes = 0;
+}
+
+/*
+ * Save the frameset of vscreen, sharing the frames that are the same as in
+ * prev.
+ */
+static void
+frame_undo_save(rp_frame_undo *u, rp_vscreen *vscreen, rp_frame_undo *prev)
+{
+	struct rp_frame_snapshot *same;
+	rp_frame *cur;
+	int i, j;
+
+	u->vscreen = vscreen;
+	u->nframes = num_frames(vscreen);
+	u->frames = xmalloc(u->nframes * sizeof(struct rp_frame_snapshot *));
+
+	if (prev && prev->vscreen != vscreen)
+		prev = NULL;
+
+	i = 0;
+	list_for_each_entry(cur, &vscreen->frames, node) {
+		same = NULL;
+		if (prev) {
+			/* Frames mostly keep their place in the list. */
+			if (i < prev->nframes &&
+			    prev->frames[i]->number == cur->number)
+				same = prev->frames[i];
+			for (j = 0; same == NULL && j < prev->nframes; j++) {
+				if (prev->frames[j]->number == cur->number)
+					same = prev->frames[j];
+			}
+		}
+		u->frames[i++] = frame_snapshot(cur, same);
 	}
 }
 
+static rp_frame_undo *
+frame_undo_top(struct frame_undo_ring *r)
+{
+	return r->count ? &r->entries[r->top] : NULL;
+}
+
+/* Make room for a new entry at the top, dropping the oldest if full. */
+static rp_frame_undo *
+frame_undo_push(struct frame_undo_ring *r)
+{
+	if (r->size == 0)
+		return NULL;
+
+	r->top = (r->top + 1) % r->size;
+	if (r->count == r->size)
+		frame_undo_free(&r->entries[r->top]);
+	else
+		r->count++;
+
+	return &r->entries[r->top];
+}
+
+/* Take the top entry off, the caller has to free it. */
+static int
+frame_undo_pop(struct frame_undo_ring *r, rp_frame_undo *u)
+{
+	if (r->count == 0)
+		return 0;
+
+	*u = r->entries[r->top];
+	r->top = (r->top + r->size - 1) % r->size;
+	r->count--;
+
+	return 1;
+}
+
 static void
-del_frame_undo(rp_frame_undo *u)
+frame_undo_clear(struct frame_undo_ring *r)
 {
-	if (!u)
-		return;
+	rp_frame_undo u;
 
-	free(u->frames);
-	list_del(&(u->node));
-	free(u);
+	while (frame_undo_pop(r, &u))
+		frame_undo_free(&u);
+}
+
+/* Change how many entries fit, keeping the newest ones. */
+static void
+frame_undo_resize(struct frame_undo_ring *r, int size)
+{
+	rp_frame_undo *entries;
+	int i, count;
+
+	while (r->count > size) {
+		/* Delete the oldest entry */
+		frame_undo_free(&r->entries[(r->top + r->size - r->count + 1) %
+		    r->size]);
+		r->count--;
+	}
+
+	entries = xmalloc((size ? size : 1) * sizeof(rp_frame_undo));
+	count = r->count;
+	for (i = count - 1; i >= 0; i--)
+		frame_undo_pop(r, &entries[i]);
+
+	free(r->entries);
+	r->entries = entries;
+	r->size = size;
+	r->count = count;
+	r->top = count ? count - 1 : size - 1;
+	if (r->top < 0)
+		r->top = 0;
 }
 
 void
 clear_frame_undos(void)
 {
-	while (list_size(&rp_frame_undos) > 0) {
-		/* Delete the oldest node */
-		rp_frame_undo *cur;
-		list_last(cur, &rp_frame_undos, node);
-		del_frame_undo(cur);
-	}
+	frame_undo_clear(&frame_undos);
+	frame_undo_clear(&frame_redos);
 }
 
 static void
 push_frame_undo(rp_vscreen *vscreen)
 {
-	rp_frame_undo *cur;
+	rp_frame_undo *prev, *cur;
 
-	if (list_size(&rp_frame_undos) > defaults.maxundos) {
-		/* Delete the oldest node */
-		list_last(cur, &rp_frame_undos, node);
-		del_frame_undo(cur);
+	if (frame_undos.size != defaults.maxundos) {
+		frame_undo_resize(&frame_undos, defaults.maxundos);
+		frame_undo_resize(&frame_redos, defaults.maxundos);
 	}
-	cur = xmalloc(sizeof(rp_frame_undo));
-	cur->frames = fdump(vscreen);
-	cur->vscreen = vscreen;
-	list_add(&cur->node, &rp_frame_undos);
+
+	/*
+	 * Share what didn't change since the last save, unless that is about
+	 * to be overwritten.
+	 */
+	prev = frame_undo_top(&frame_undos);
+	if (frame_undos.size == 1)
+		prev = NULL;
+
+	if ((cur = frame_undo_push(&frame_undos)) != NULL)
+		frame_undo_save(cur, vscreen, prev);
+
 	/*
 	 * Since we're creating new frames the redo list is now invalid, so
 	 * clear it.
 	 */
-	clear_frame_redos();
+	frame_undo_clear(&frame_redos);
 }
 
-static rp_frame_undo *
-pop_frame_list(struct list_head *undo_list, struct list_head *redo_list)
+/*
+ * Take the newest frameset off one ring, saving the current layout on the
+ * other one.
+ */
+static int
+pop_frame_list(struct frame_undo_ring *undo_ring,
+    struct frame_undo_ring *redo_ring, rp_frame_undo *u)
 {
-	rp_vscreen *vscreen = rp_current_vscreen;
-	rp_frame_undo *first, *new;
+	rp_frame_undo *new;
 
 	/* Is there something to restore? */
-	list_first(first, undo_list, node);
-	if (!first)
-		return NULL;
+	if (!frame_undo_pop(undo_ring, u))
+		return 0;
 
 	/* First save the current layout into undo */
-	new = xmalloc(sizeof(rp_frame_undo));
-	new->frames = fdump(vscreen);
-	new->vscreen = vscreen;
-	list_add(&new->node, redo_list);
+	if ((new = frame_undo_push(redo_ring)) != NULL)
+		frame_undo_save(new, rp_current_vscreen, u);
 
-	list_del(&(first->node));
-	return first;
+	return 1;
 }
 
 /* Pop the head of the frame undo list off and put it in the redo list. */
-static rp_frame_undo *
-pop_frame_undo(void)
+static int
+pop_frame_undo(rp_frame_undo *u)
 {
-	return pop_frame_list(&rp_frame_undos, &rp_frame_redos);
+	return pop_frame_list(&frame_undos, &frame_redos, u);
 }
 
 /* Pop the head of the frame redo list off and put it in the undo list. */
-static rp_frame_undo *
-pop_frame_redo(void)
+static int
+pop_frame_redo(rp_frame_undo *u)
 {
-	return pop_frame_list(&rp_frame_redos, &rp_frame_undos);
+	return pop_frame_list(&frame_redos, &frame_undos, u);
 }
 
-rp_action *
-find_keybinding_by_action(char *action, rp_keymap *map)
+static unsigned int
+keymap_key_hash(KeySym keysym, unsigned int state)
+{
+	return ((unsigned int)keysym * 2654435761u) ^ (state * 40503u);
+}
+
+/*
+ * Find the key_index or action_index slot for an action, which is either the
+ * slot of the first action matching it or the empty slot it would go in.
+ */
+static int *
+keymap_key_slot(rp_keymap *map, KeySym keysym, unsigned int state)
+{
+	unsigned int i, mask = map->index_size - 1;
+	rp_action *a;
+
+	for (i = keymap_key_hash(keysym, state) & mask;
+	    map->key_index[i] != -1; i = (i + 1) & mask) {
+		a = &map->actions[map->key_index[i]];
+		if (a->key == keysym && a->state == state)
+			break;
+	}
+
+	return &map->key_index[i];
+}
+
+static int *
+keymap_action_slot(rp_keymap *map, char *data)
+{
+	unsigned int i, mask = map->index_size - 1;
+
+	for (i = symbol_hash(data) & mask; map->action_index[i] != -1;
+	    i = (i + 1) & mask) {
+		if (!strcmp(map->actions[map->action_index[i]].data, data))
+			break;
+	}
+
+	return &map->action_index[i];
+}
+
+static void
+keymap_index_add(rp_keymap *map, int n)
+{
+	int *slot;
+
+	slot = keymap_key_slot(map, map->actions[n].key, map->actions[n].state);
+	if (*slot == -1)
+		*slot = n;
+
+	slot = keymap_action_slot(map, map->actions[n].data);
+	if (*slot == -1)
+		*slot = n;
+}
+
+/*
+ * Rebuild both indexes, growing them to stay at most half full.  Removing or
+ * rebinding a key moves or renames actions, so those rebuild too.
+ */
+static void
+keymap_reindex(rp_keymap *map)
 {
 	int i;
 
-	for (i = 0; i < map->actions_last; i++) {
-		if (!strcmp(map->actions[i].data, action)) {
-			return &map->actions[i];
-		}
+	if (map->index_size < map->actions_size * 2) {
+		if (map->index_size == 0)
+			map->index_size = 16;
+		while (map->index_size < map->actions_size * 2)
+			map->index_size *= 2;
+
+		free(map->key_index);
+		free(map->action_index);
+		map->key_index = xmalloc(sizeof(int) * map->index_size);
+		map->action_index = xmalloc(sizeof(int) * map->index_size);
 	}
 
-	return NULL;
+	memset(map->key_index, 0xff, sizeof(int) * map->index_size);
+	memset(map->action_index, 0xff, sizeof(int) * map->index_size);
+
+	for (i = 0; i < map->actions_last; i++)
+		keymap_index_add(map, i);
+}
+
+rp_action *
+find_keybinding_by_action(char *action, rp_keymap *map)
+{
+	int n = *keymap_action_slot(map, action);
+
+	return n == -1 ? NULL : &map->actions[n];
 }
 
 rp_action *
 find_keybinding(KeySym keysym, unsigned int state, rp_keymap *map)
 {
-	int i;
-	for (i = 0; i < map->actions_last; i++) {
-		if (map->actions[i].key == keysym &&
-		    map->actions[i].state == state)
-			return &map->actions[i];
-	}
-	return NULL;
+	int n = *keymap_key_slot(map, keysym, state);
+
+	return n == -1 ? NULL : &map->actions[n];
 }
 
 static char *
 find_command_by_keydesc(char *desc, rp_keymap *map)
 {
-	int i = 0;
-	char *keysym_name;
+	struct rp_key key;
+	rp_action *action;
+	cmdret *ret;
 
-	while (i < map->actions_last) {
-		keysym_name = keysym_to_string(map->actions[i].key,
-		    map->actions[i].state);
-		if (!strcmp(keysym_name, desc)) {
-			free(keysym_name);
-			return map->actions[i].data;
-		}
-		free(keysym_name);
-		i++;
+	if ((ret = parse_keydesc(desc, &key))) {
+		cmdret_free(ret);
+		return NULL;
 	}
 
-	return NULL;
+	action = find_keybinding(key.sym, key.state, map);
+	return action ? action->data : NULL;
 }
 
 static char *
@@ -757,37 +1076,39 @@ add_keybinding(KeySym keysym, int state, char *cmd, rp_keymap *map)
 	map->actions[map->actions_last].state = state;
 	/* free this on shutdown, or re/unbinding */
 	map->actions[map->actions_last].data = xstrdup(cmd);
+	map->actions[map->actions_last].compiled = NULL;
+	compile_action(&map->actions[map->actions_last]);
 
 	map->actions_last++;
+
+	if (map->index_size < map->actions_size * 2)
+		keymap_reindex(map);
+	else
+		keymap_index_add(map, map->actions_last - 1);
 }
 
 static void
-replace_keybinding(rp_action * key_action, char *newcmd)
+replace_keybinding(rp_keymap *map, rp_action *key_action, char *newcmd)
 {
 	free(key_action->data);
 	key_action->data = xstrdup(newcmd);
+	compile_action(key_action);
+	keymap_reindex(map);
 }
 
 static int
 remove_keybinding(KeySym keysym, unsigned int state, rp_keymap *map)
 {
-	int i;
-	int found = -1;
-
-	for (i = 0; i < map->actions_last; i++) {
-		if (map->actions[i].key == keysym &&
-		    map->actions[i].state == state) {
-			found = i;
-			break;
-		}
-	}
+	int found = *keymap_key_slot(map, keysym, state);
 
 	if (found >= 0) {
 		free(map->actions[found].data);
+		release_compiled_action(map->actions[found].compiled);
 
 		memmove(&map->actions[found], &map->actions[found + 1],
 		    sizeof(rp_action) * (map->actions_last - found - 1));
 		map->actions_last--;
+		keymap_reindex(map);
 
 		return 1;
 	}
@@ -809,6 +1130,9 @@ keymap_new(char *name)
 	map->actions_size = 1;
 	map->actions = xmalloc(sizeof(rp_action) * map->actions_size);
 	map->actions_last = 0;
+	map->key_index = map->action_index = NULL;
+	map->index_size = 0;
+	keymap_reindex(map);
 
 	return map;
 }
@@ -834,13 +1158,9 @@ find_keymap(char *name)
 static int
 find_alias_index(char *name)
 {
-	int i;
-
-	for (i = 0; i < alias_list_last; i++)
-		if (!strcmp(name, alias_list[i].name))
-			return i;
+	struct symbol *sym = symbol_find(name);
 
-	return -1;
+	return sym ? sym->alias : -1;
 }
 
 static void
@@ -861,8 +1181,12 @@ add_alias(char *name, char *alias)
 		}
 		alias_list[alias_list_last].name = xstrdup(name);
 		alias_list[alias_list_last].alias = xstrdup(alias);
+		symbol_add(name)->alias = alias_list_last;
 		alias_list_last++;
 	}
+
+	/* The alias may now shadow a command some key was bound to. */
+	compile_keymaps();
 }
 
 void
@@ -1018,10 +1342,13 @@ keymap_free(rp_keymap *map)
 	/* Free the data in the actions. */
 	for (i = 0; i < map->actions_last; i++) {
 		free(map->actions[i].data);
+		release_compiled_action(map->actions[i].compiled);
 	}
 
 	/* Free the map data. */
 	free(map->actions);
+	free(map->key_index);
+	free(map->action_index);
 	free(map->name);
 
 	/* ...and the map itself. */
@@ -1070,6 +1397,8 @@ free_user_commands(void)
 		list_del(&var->node);
 		set_var_free(var);
 	}
+
+	free_symbols();
 }
 
 /*
@@ -1279,7 +1608,7 @@ cmd_definekey(int interactive, struct cmdarg **args)
 		ungrab_keys_all_wins();
 
 	if ((key_action = find_keybinding(key->sym, key->state, map)))
-		replace_keybinding(key_action, cmd);
+		replace_keybinding(map, key_action, cmd);
 	else
 		add_keybinding(key->sym, key->state, cmd, map);
 
@@ -1520,7 +1849,7 @@ cmd_select(int interactive, struct cmdarg **args)
 	 */
 	if (args[0] == NULL)
 		str = get_more_input(MESSAGE_PROMPT_SWITCH_TO_WINDOW, "",
-		    hist_SELECT, SUBSTRING, window_completions);
+		    hist_SELECT, FUZZY, window_completions);
 	else
 		str = xstrdup(ARG_STRING(0));
 
@@ -1585,7 +1914,7 @@ cmd_rename(int interactive, struct cmdarg **args)
 	free(current_window()->user_name);
 	current_window()->user_name = xstrdup(ARG_STRING(0));
 	current_window()->named = 1;
-	hook_run(&rp_title_changed_hook);
+	hook_run_window(&rp_title_changed_hook, current_window());
 
 	/* Update the program bar. */
 	update_window_names(rp_current_screen, defaults.window_fmt);
@@ -1827,62 +2156,179 @@ read_command(struct argspec *spec, struct sbuf *s, struct cmdarg **arg)
 	return read_string(spec, s, hist_COMMAND, colon_completions, arg);
 }
 
-static struct list_head *
-exec_completions(char *str)
+/*
+ * Every executable in $PATH, sorted and without duplicates, so exec
+ * completions are a binary search instead of a trip through the shell.  The
+ * index is rebuilt when $PATH or the modification time of one of its
+ * directories changes.
+ */
+struct exec_dir {
+	char *path;
+	time_t mtime;
+};
+
+static char *exec_path = NULL;
+static struct exec_dir *exec_dirs = NULL;
+static int exec_ndirs = 0;
+static char **exec_names = NULL;
+static int exec_nnames = 0;
+
+static int
+exec_name_cmp(const void *a, const void *b)
 {
-	size_t n = 256;
-	char *partial;
-	struct sbuf *line;
-	FILE *file;
-	struct list_head *head;
-	char *completion_string;
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
 
-	/* Initialize our list. */
-	head = xmalloc(sizeof(struct list_head));
-	INIT_LIST_HEAD(head);
+static void
+exec_index_add_dir(struct exec_dir *dir, int *size)
+{
+	struct dirent *ent;
+	struct stat st;
+	char *file;
+	DIR *d;
+
+	if ((d = opendir(dir->path)) == NULL)
+		return;
 
-	/* FIXME: A Bash dependancy?? */
-	completion_string = xsprintf("bash -c \"compgen -ac %s|sort\"", str);
-	file = popen(completion_string, "r");
-	free(completion_string);
-	if (!file) {
-		warn("popen failed");
-		return head;
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' ||
+		    (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+			continue;
+
+		file = xsprintf("%s/%s", dir->path, ent->d_name);
+		if (stat(file, &st) == -1 || S_ISDIR(st.st_mode) ||
+		    access(file, X_OK) == -1) {
+			free(file);
+			continue;
+		}
+		free(file);
+
+		if (exec_nnames == *size) {
+			*size = *size ? *size * 2 : 256;
+			exec_names = xrealloc(exec_names,
+			    *size * sizeof(char *));
+		}
+		exec_names[exec_nnames++] = xstrdup(ent->d_name);
 	}
-	partial = xmalloc(n);
 
-	/*
-	 * Read data from the file, split it into lines and store it in a list.
-	 */
-	line = sbuf_new(0);
-	while (fgets(partial, n, file) != NULL) {
-		/* Read a chunk from the file into our line accumulator. */
-		sbuf_concat(line, partial);
+	closedir(d);
+}
 
-		if (feof(file) ||
-		    (*(sbuf_get(line) + strlen(sbuf_get(line)) - 1) == '\n')) {
-			char *s;
-			struct sbuf *elem;
+static void
+exec_index_rebuild(void)
+{
+	int i, j, size = 0;
+
+	for (i = 0; i < exec_nnames; i++)
+		free(exec_names[i]);
+	free(exec_names);
+	exec_names = NULL;
+	exec_nnames = 0;
 
-			s = sbuf_get(line);
+	for (i = 0; i < exec_ndirs; i++)
+		exec_index_add_dir(&exec_dirs[i], &size);
 
-			/* Frob the newline into */
-			if (*(s + strlen(s) - 1) == '\n')
-				*(s + strlen(s) - 1) = '\0';
+	if (exec_nnames == 0)
+		return;
 
-			/* Add our line to the list. */
-			elem = sbuf_new(0);
-			sbuf_copy(elem, s);
-			list_add_tail(&elem->node, head);
+	qsort(exec_names, exec_nnames, sizeof(char *), exec_name_cmp);
 
-			sbuf_clear(line);
+	/* The same name may appear in several directories. */
+	for (i = 1, j = 0; i < exec_nnames; i++) {
+		if (strcmp(exec_names[i], exec_names[j]) == 0)
+			free(exec_names[i]);
+		else
+			exec_names[++j] = exec_names[i];
+	}
+	exec_nnames = j + 1;
+
+	PRINT_DEBUG(("indexed %d executables in %d directories\n",
+	    exec_nnames, exec_ndirs));
+}
+
+/* Make sure the index matches $PATH and the directories in it. */
+static void
+exec_index_refresh(void)
+{
+	char *path, *dir, *tmp;
+	struct stat st;
+	int i, stale = 0;
+
+	if ((path = getenv("PATH")) == NULL)
+		path = "";
+
+	if (exec_path == NULL || strcmp(exec_path, path) != 0) {
+		for (i = 0; i < exec_ndirs; i++)
+			free(exec_dirs[i].path);
+		free(exec_dirs);
+		exec_dirs = NULL;
+		exec_ndirs = 0;
+
+		free(exec_path);
+		exec_path = xstrdup(path);
+
+		tmp = xstrdup(path);
+		path = tmp;
+		while ((dir = strsep(&path, ":")) != NULL) {
+			/* An empty entry means the current directory. */
+			if (*dir == '\0')
+				dir = ".";
+			exec_dirs = xrealloc(exec_dirs,
+			    (exec_ndirs + 1) * sizeof(struct exec_dir));
+			exec_dirs[exec_ndirs].path = xstrdup(dir);
+			exec_dirs[exec_ndirs].mtime = -1;
+			exec_ndirs++;
+		}
+		free(tmp);
+
+		stale = 1;
+	}
+
+	for (i = 0; i < exec_ndirs; i++) {
+		if (stat(exec_dirs[i].path, &st) == -1)
+			st.st_mtime = -1;
+		if (st.st_mtime != exec_dirs[i].mtime) {
+			exec_dirs[i].mtime = st.st_mtime;
+			stale = 1;
 		}
 	}
 
-	sbuf_free(line);
+	if (stale)
+		exec_index_rebuild();
+}
+
+static struct list_head *
+exec_completions(char *str)
+{
+	struct list_head *head;
+	struct sbuf *elem;
+	size_t len = strlen(str);
+	int lo, hi, mid;
+
+	/* Initialize our list. */
+	head = xmalloc(sizeof(struct list_head));
+	INIT_LIST_HEAD(head);
+
+	exec_index_refresh();
 
-	free(partial);
-	pclose(file);
+	/* Find the first name not sorting before str. */
+	lo = 0;
+	hi = exec_nnames;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(exec_names[mid], str) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Every name that starts with str follows it. */
+	for (; lo < exec_nnames && strncmp(exec_names[lo], str, len) == 0;
+	    lo++) {
+		elem = sbuf_new(0);
+		sbuf_copy(elem, exec_names[lo]);
+		list_add_tail(&elem->node, head);
+	}
 
 	return head;
 }
@@ -1979,8 +2425,10 @@ read_frame(struct sbuf *s, struct cmdarg **arg)
 		read_single_key(&c, &mod, keysym_buf, keysym_bufsize);
 
 		/* Destroy our number windows and free the array. */
-		for (i = 0; i < frames; i++)
+		for (i = 0; i < frames; i++) {
+			rp_uncache_draw(wins[i]);
 			XDestroyWindow(dpy, wins[i]);
+		}
 
 		free(wins);
 
@@ -2216,7 +2664,7 @@ read_hook(struct argspec *spec, struct sbuf *s, struct cmdarg **arg)
 		input = get_input(spec->prompt, hist_HOOK, hook_completions);
 
 	if (input) {
-		struct list_head *hook = hook_lookup(input);
+		struct list_head *hook = find_hook(input);
 
 		if (hook) {
 			*arg = xmalloc(sizeof(struct cmdarg));
@@ -2239,14 +2687,9 @@ read_hook(struct argspec *spec, struct sbuf *s, struct cmdarg **arg)
 static struct set_var *
 find_variable(char *str)
 {
-	struct set_var *cur;
+	struct symbol *sym = symbol_find(str);
 
-	list_for_each_entry(cur, &set_vars, node) {
-		if (!strcmp(str, cur->var))
-			return cur;
-	}
-
-	return NULL;
+	return sym ? sym->var : NULL;
 }
 
 static struct list_head *
@@ -2614,6 +3057,7 @@ command(int interactive, char *data)
 	char *cmd, *rest;
 	char *input;
 	struct user_command *uc;
+	struct symbol *sym;
 	int i;
 
 	if (data == NULL)
@@ -2640,11 +3084,10 @@ command(int interactive, char *data)
 	}
 	PRINT_DEBUG(("cmd==%s rest==%s\n", cmd, rest ? rest : "NULL"));
 
-	/* Look for it in the aliases, first. */
-	for (i = 0; i < alias_list_last; i++) {
-		if (strcmp(cmd, alias_list[i].name) != 0)
-			continue;
+	sym = symbol_find(cmd);
 
+	/* Look for it in the aliases, first. */
+	if (sym && (i = sym->alias) >= 0) {
 		struct sbuf *s;
 
 		/*
@@ -2670,10 +3113,7 @@ command(int interactive, char *data)
 	}
 
 	/* If it wasn't an alias, maybe its a command. */
-	list_for_each_entry(uc, &user_commands, node) {
-		if (strcmp(cmd, uc->name) != 0)
-			continue;
-
+	if (sym && (uc = sym->uc)) {
 		struct sbuf *scur;
 		struct cmdarg *acur;
 		struct list_head *iter, *tmp;
@@ -2748,6 +3188,163 @@ done:
 	return result;
 }
 
+static void
+release_compiled_action(struct compiled_action *ca)
+{
+	int i;
+
+	if (ca == NULL || --ca->refs > 0)
+		return;
+
+	for (i = 0; ca->args[i]; i++)
+		arg_free(ca->args[i]);
+	free(ca->args);
+	free(ca);
+}
+
+/*
+ * Whether an argument of this type reads the same every time it is parsed.
+ * Windows, frames and the like depend on the state at the time the key is
+ * pressed, and keys and hooks are left alone as well.
+ */
+static int
+arg_type_is_constant(int type)
+{
+	switch (type) {
+	case arg_STRING:
+	case arg_REST:
+	case arg_RAW:
+	case arg_NUMBER:
+	case arg_GRAVITY:
+	case arg_COMMAND:
+	case arg_SHELLCMD:
+	case arg_KEYMAP:
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Resolve the command bound to a key the way command() would when the key is
+ * pressed interactively.  Anything it can't do ahead of time, such as
+ * aliases, prompting for missing arguments or errors, is left for command()
+ * by not compiling the action at all.
+ */
+static void
+compile_action(rp_action *action)
+{
+	struct compiled_action *ca = NULL;
+	struct user_command *uc;
+	struct symbol *sym;
+	struct list_head head, args;
+	struct list_head *iter, *tmp;
+	struct sbuf *scur;
+	struct cmdarg *acur;
+	cmdret *ret;
+	char *input, *cmd, *rest;
+	int i, nargs = 0, raw = 0;
+
+	release_compiled_action(action->compiled);
+	action->compiled = NULL;
+
+	INIT_LIST_HEAD(&head);
+	INIT_LIST_HEAD(&args);
+
+	input = xstrdup(action->data);
+	cmd = input;
+	while (*cmd && isspace((unsigned char) *cmd))
+		cmd++;
+	rest = cmd;
+	while (*rest && !isspace((unsigned char) *rest))
+		rest++;
+	if (*rest) {
+		*rest = 0;
+		rest++;
+	}
+
+	sym = symbol_find(cmd);
+	if (sym == NULL || sym->alias >= 0 || (uc = sym->uc) == NULL)
+		goto done;
+
+	for (i = 0; i < uc->num_args; i++)
+		if (uc->args[i].type == arg_REST ||
+		    uc->args[i].type == arg_COMMAND ||
+		    uc->args[i].type == arg_SHELLCMD ||
+		    uc->args[i].type == arg_RAW) {
+			raw = 1;
+			nargs = i;
+			break;
+		}
+
+	if ((ret = parse_args(rest, &head, nargs, raw))) {
+		cmdret_free(ret);
+		goto done;
+	}
+
+	if (list_size(&head) > uc->num_args ||
+	    list_size(&head) < uc->i_required_args)
+		goto done;
+
+	for (i = 0; i < list_size(&head); i++)
+		if (!arg_type_is_constant(uc->args[i].type))
+			goto done;
+
+	if ((ret = parsed_input_to_args(uc->num_args, uc->args, &head, &args,
+	    &i, uc->name))) {
+		cmdret_free(ret);
+		goto done;
+	}
+
+	ca = xmalloc(sizeof(struct compiled_action));
+	ca->uc = uc;
+	ca->args = arg_array(&args);
+	ca->refs = 1;
+	INIT_LIST_HEAD(&args);
+
+	PRINT_DEBUG(("compiled keybinding \"%s\"\n", action->data));
+
+done:
+	list_for_each_safe_entry(scur, iter, tmp, &head, node)
+	    sbuf_free(scur);
+	list_for_each_safe_entry(acur, iter, tmp, &args, node)
+	    arg_free(acur);
+	free(input);
+
+	action->compiled = ca;
+}
+
+/* Recompile every keybinding after aliases or keymaps changed. */
+static void
+compile_keymaps(void)
+{
+	rp_keymap *map;
+	int i;
+
+	list_for_each_entry(map, &rp_keymaps, node) {
+		for (i = 0; i < map->actions_last; i++)
+			compile_action(&map->actions[i]);
+	}
+}
+
+/* Run the command bound to a key. */
+cmdret *
+command_action(int interactive, rp_action *action)
+{
+	struct compiled_action *ca = action->compiled;
+	cmdret *result;
+
+	if (ca == NULL || !interactive)
+		return command(interactive, action->data);
+
+	/* The command may rebind the key, keep ours around until it's done. */
+	ca->refs++;
+	result = ca->uc->func(interactive, ca->args);
+	release_compiled_action(ca);
+
+	return result;
+}
+
 cmdret *
 cmd_colon(int interactive, struct cmdarg **args)
 {
@@ -2755,11 +3352,11 @@ cmd_colon(int interactive, struct cmdarg **args)
 	char *input;
 
 	if (args[0] == NULL)
-		input = get_input(MESSAGE_PROMPT_COMMAND, hist_COMMAND,
-		    colon_completions);
+		input = get_more_input(MESSAGE_PROMPT_COMMAND, "",
+		    hist_COMMAND, FUZZY, colon_completions);
 	else
 		input = get_more_input(MESSAGE_PROMPT_COMMAND, ARG_STRING(0),
-		    hist_COMMAND, BASIC, colon_completions);
+		    hist_COMMAND, FUZZY, colon_completions);
 
 	/* User aborted. */
 	if (input == NULL)
@@ -2895,6 +3492,10 @@ cmd_number(int interactive, struct cmdarg **args)
 		win = vscreen_find_window(&rp_current_vscreen->mapped_windows,
 		    current_window());
 
+	if (new_number > NUMSET_MAX)
+		return cmdret_new(RET_FAILURE, "number: %d is too big (max %d)",
+		    new_number, NUMSET_MAX);
+
 	/* Make the switch. */
 	if (new_number >= 0 && win) {
 		/* Find other window with same number and give it old number. */
@@ -2902,19 +3503,18 @@ cmd_number(int interactive, struct cmdarg **args)
 		    new_number);
 		if (other_win != NULL) {
 			old_number = win->number;
-			other_win->number = old_number;
 
-			/* Resort the window in the list */
-			vscreen_resort_window(rp_current_vscreen, other_win);
+			/* Renumber and resort the window in the list */
+			vscreen_renumber_window(rp_current_vscreen, other_win,
+			    old_number);
 		} else {
 			numset_release(rp_current_vscreen->numset, win->number);
 		}
 
-		win->number = new_number;
 		numset_add_num(rp_current_vscreen->numset, new_number);
 
-		/* resort the the window in the list */
-		vscreen_resort_window(rp_current_vscreen, win);
+		/* renumber and resort the the window in the list */
+		vscreen_renumber_window(rp_current_vscreen, win, new_number);
 
 		/* Update the window list. */
 		update_window_names(win->win->vscreen->screen,
@@ -2999,6 +3599,9 @@ cmd_escape(int interactive, struct cmdarg **args)
 			action->state = RP_CONTROL_MASK;
 	}
 
+	/* Both bindings moved to a different key. */
+	keymap_reindex(map);
+
 	/* Remove the grab on the current prefix key */
 	ungrab_keys_all_wins();
 
@@ -3006,6 +3609,7 @@ cmd_escape(int interactive, struct cmdarg **args)
 	if (action != NULL && !strcmp(action->data, "readkey " ROOT_KEYMAP)) {
 		action->key = key->sym;
 		action->state = key->state;
+		keymap_reindex(top);
 	}
 
 	/* Add the grab for the new prefix key */
@@ -3053,7 +3657,7 @@ cmd_vsplit(int interactive, struct cmdarg **args)
 	rp_frame *frame;
 	int pixels;
 
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 	frame = current_frame(rp_current_vscreen);
 
 	/* Default to dividing the frame in half. */
@@ -3081,7 +3685,7 @@ cmd_hsplit(int interactive, struct cmdarg **args)
 	rp_frame *frame;
 	int pixels;
 
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 	frame = current_frame(rp_current_vscreen);
 
 	/* Default to dividing the frame in half. */
@@ -3105,7 +3709,7 @@ cmd_hsplit(int interactive, struct cmdarg **args)
 cmdret *
 cmd_only(int interactive, struct cmdarg **args)
 {
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 	remove_all_splits();
 	maximize(current_window());
 
@@ -3117,7 +3721,7 @@ cmd_remove(int interactive, struct cmdarg **args)
 {
 	rp_frame *frame;
 
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 
 	if (num_frames(rp_current_vscreen) <= 1)
 		return cmdret_new(RET_FAILURE,
@@ -3136,7 +3740,7 @@ cmd_remove(int interactive, struct cmdarg **args)
 cmdret *
 cmd_shrink(int interactive, struct cmdarg **args)
 {
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 	resize_shrink_to_window(current_frame(rp_current_vscreen));
 	return cmdret_new(RET_SUCCESS, NULL);
 }
@@ -3795,6 +4399,21 @@ set_historysize(struct cmdarg **args)
 	return cmdret_new(RET_SUCCESS, NULL);
 }
 
+static cmdret *
+set_historycompaction(struct cmdarg **args)
+{
+	if (args[0] == NULL)
+		return cmdret_new(RET_SUCCESS, "%d",
+		    defaults.history_compaction);
+
+	if (ARG(0, number) != 0 && ARG(0, number) != 1)
+		return cmdret_new(RET_FAILURE,
+		    "set historycompaction: invalid argument");
+
+	defaults.history_compaction = ARG(0, number);
+	return cmdret_new(RET_SUCCESS, NULL);
+}
+
 static cmdret *
 set_font(struct cmdarg **args)
 {
@@ -3813,6 +4432,8 @@ set_font(struct cmdarg **args)
 
 		XftFontClose(dpy, s->xft_font);
 		s->xft_font = font;
+		rp_clear_font_widths(&s->xft_default_font);
+		rp_init_font(&s->xft_default_font, NULL, font);
 	}
 
 	free(defaults.font_string);
@@ -3826,6 +4447,27 @@ set_font(struct cmdarg **args)
 	return cmdret_new(RET_SUCCESS, NULL);
 }
 
+static cmdret *
+set_fontcachesize(struct cmdarg **args)
+{
+	rp_screen *s;
+
+	if (args[0] == NULL)
+		return cmdret_new(RET_SUCCESS, "%d", defaults.font_cache_size);
+
+	if (ARG(0, number) < 1)
+		return cmdret_new(RET_FAILURE,
+		    "set fontcachesize: invalid argument");
+
+	defaults.font_cache_size = ARG(0, number);
+
+	/* Close any fonts that no longer fit */
+	list_for_each_entry(s, &rp_screens, node)
+		rp_trim_cached_fonts(s, defaults.font_cache_size);
+
+	return cmdret_new(RET_SUCCESS, NULL);
+}
+
 static cmdret *
 set_padding(struct cmdarg **args)
 {
@@ -3967,6 +4609,21 @@ set_barinpadding(struct cmdarg **args)
 	return cmdret_new(RET_SUCCESS, NULL);
 }
 
+static cmdret *
+set_barmaxfps(struct cmdarg **args)
+{
+	if (args[0] == NULL)
+		return cmdret_new(RET_SUCCESS, "%d", defaults.bar_max_fps);
+
+	if (ARG(0, number) < 0)
+		return cmdret_new(RET_FAILURE, "set barmaxfps: %s",
+		    invalid_negative_arg);
+
+	defaults.bar_max_fps = ARG(0, number);
+
+	return cmdret_new(RET_SUCCESS, NULL);
+}
+
 static cmdret *
 set_inputwidth(struct cmdarg **args)
 {
@@ -4104,6 +4761,9 @@ set_fgcolor(struct cmdarg **args)
 		rp_glob_screen.fgcolor = color.pixel | (0xff << 24);
 		update_gc(s);
 
+		XftColorFree(dpy, DefaultVisual(dpy, s->screen_num),
+		    DefaultColormap(dpy, s->screen_num), &s->xft_fgcolor);
+		rp_clear_cached_colors(s);
 		if (!XftColorAllocName(dpy, DefaultVisual(dpy, s->screen_num),
 		    DefaultColormap(dpy, s->screen_num), ARG_STRING(0),
 		    &s->xft_fgcolor))
@@ -4142,6 +4802,9 @@ set_bgcolor(struct cmdarg **args)
 		XSetWindowBackground(dpy, s->frame_window, color.pixel);
 		XSetWindowBackground(dpy, s->help_window, color.pixel);
 
+		XftColorFree(dpy, DefaultVisual(dpy, s->screen_num),
+		    DefaultColormap(dpy, s->screen_num), &s->xft_bgcolor);
+		rp_clear_cached_colors(s);
 		if (!XftColorAllocName(dpy, DefaultVisual(dpy, s->screen_num),
 		    DefaultColormap(dpy, s->screen_num), ARG_STRING(0),
 		    &s->xft_bgcolor))
@@ -4719,6 +5382,10 @@ cmd_unalias(int interactive, struct cmdarg **args)
 
 	alias_list_last--;
 
+	symbol_find(ARG_STRING(0))->alias = -1;
+	if (i != alias_list_last)
+		symbol_find(alias_list[alias_list_last].name)->alias = i;
+
 	/*
 	 * Free the alias and put the last alias in the the space to
 	 * keep alias_list from becoming sparse. This code must jump
@@ -4736,6 +5403,8 @@ cmd_unalias(int interactive, struct cmdarg **args)
 	free(tmp);
 	free(alias_list[alias_list_last].name);
 
+	compile_keymaps();
+
 	return cmdret_new(RET_SUCCESS, NULL);
 }
 
@@ -4911,40 +5580,13 @@ cmd_fdump(int interactively, struct cmdarg **args)
 	return ret;
 }
 
-cmdret *
-frestore(char *data, rp_vscreen *v)
+/* Replace the frames of v with fset, showing the windows in them. */
+static cmdret *
+frestore_frameset(struct list_head *fset, rp_vscreen *v)
 {
-	char *token;
-	char *d;
-	rp_frame *new, *cur;
+	rp_frame *cur;
 	rp_window *win;
-	struct list_head fset;
 	int max = -1;
-	char *nexttok = NULL;
-
-	INIT_LIST_HEAD(&fset);
-
-	d = xstrdup(data);
-	token = strtok_r(d, ",", &nexttok);
-	if (token == NULL) {
-		free(d);
-		return cmdret_new(RET_FAILURE,
-		    "frestore: invalid frame format");
-	}
-
-	/* Build the new frame set. */
-	while (token != NULL) {
-		new = frame_read(token, v);
-		if (new == NULL) {
-			free(d);
-			return cmdret_new(RET_FAILURE,
-			    "frestore: invalid frame format");
-		}
-		list_add_tail(&new->node, &fset);
-		token = strtok_r(NULL, ",", &nexttok);
-	}
-
-	free(d);
 
 	/* Clear all the frames. */
 	list_for_each_entry(cur, &v->frames, node) {
@@ -4956,7 +5598,7 @@ frestore(char *data, rp_vscreen *v)
 	vscreen_free_nums(v);
 
 	/* Splice in our new frameset. */
-	vscreen_restore_frameset(v, &fset);
+	vscreen_restore_frameset(v, fset);
 
 	/* Process the frames a bit to make sure everything lines up. */
 	list_for_each_entry(cur, &v->frames, node) {
@@ -4997,10 +5639,61 @@ frestore(char *data, rp_vscreen *v)
 	return cmdret_new(RET_SUCCESS, NULL);
 }
 
+/* Restore a frameset saved by push_frame_undo. */
+static cmdret *
+frestore_undo(rp_frame_undo *u)
+{
+	struct list_head fset;
+	int i;
+
+	INIT_LIST_HEAD(&fset);
+	for (i = 0; i < u->nframes; i++)
+		list_add_tail(&frame_restore(u->frames[i], u->vscreen)->node,
+		    &fset);
+
+	return frestore_frameset(&fset, u->vscreen);
+}
+
+cmdret *
+frestore(char *data, rp_vscreen *v)
+{
+	char *token;
+	char *d;
+	rp_frame *new;
+	struct list_head fset;
+	char *nexttok = NULL;
+
+	INIT_LIST_HEAD(&fset);
+
+	d = xstrdup(data);
+	token = strtok_r(d, ",", &nexttok);
+	if (token == NULL) {
+		free(d);
+		return cmdret_new(RET_FAILURE,
+		    "frestore: invalid frame format");
+	}
+
+	/* Build the new frame set. */
+	while (token != NULL) {
+		new = frame_read(token, v);
+		if (new == NULL) {
+			free(d);
+			return cmdret_new(RET_FAILURE,
+			    "frestore: invalid frame format");
+		}
+		list_add_tail(&new->node, &fset);
+		token = strtok_r(NULL, ",", &nexttok);
+	}
+
+	free(d);
+
+	return frestore_frameset(&fset, v);
+}
+
 cmdret *
 cmd_frestore(int interactively, struct cmdarg **args)
 {
-	push_frame_undo(rp_current_vscreen);	/* fdump to stack */
+	push_frame_undo(rp_current_vscreen);	/* save for undo */
 	return frestore(ARG_STRING(0), rp_current_vscreen);
 }
 
@@ -5127,7 +5820,7 @@ cmd_addhook(int interactive, struct cmdarg **args)
 	struct list_head *hook;
 	struct sbuf *cmd;
 
-	hook = hook_lookup(ARG_STRING(0));
+	hook = find_hook(ARG_STRING(0));
 	if (hook == NULL)
 		return cmdret_new(RET_FAILURE, "addhook: unknown hook '%s'",
 		    ARG_STRING(0));
@@ -5162,7 +5855,7 @@ cmd_listhook(int interactive, struct cmdarg **args)
 	struct list_head *hook;
 	struct sbuf *cur;
 
-	hook = hook_lookup(ARG_STRING(0));
+	hook = find_hook(ARG_STRING(0));
 	if (hook == NULL)
 		return cmdret_new(RET_FAILURE, "listhook: unknown hook '%s'",
 		    ARG_STRING(0));
@@ -5211,7 +5904,7 @@ cmd_readkey(int interactive, struct cmdarg **args)
 		ungrab_rat();
 
 	if ((key_action = find_keybinding(keysym, x11_mask_to_rp_mask(mod), map))) {
-		return command(1, key_action->data);
+		return command_action(1, key_action);
 	}
 
 	/* No key match, notify user. */
@@ -5233,6 +5926,7 @@ cmd_newkmap(int interactive, struct cmdarg **args)
 
 	map = keymap_new(ARG_STRING(0));
 	list_add_tail(&map->node, &rp_keymaps);
+	compile_keymaps();
 
 	return cmdret_new(RET_SUCCESS, NULL);
 }
@@ -5251,6 +5945,7 @@ cmd_delkmap(int interactive, struct cmdarg **args)
 		    "delkmap: cannot delete keymap '%s'", ARG_STRING(0));
 
 	list_del(&map->node);
+	compile_keymaps();
 
 	return cmdret_new(RET_SUCCESS, NULL);
 }
@@ -5450,7 +6145,7 @@ cmd_sfrestore(int interactively, struct cmdarg **args)
 		if (strlen(sbuf_get(screen->scratch_buffer)) == 0)
 			continue;
 
-		push_frame_undo(screen->current_vscreen); /* fdump to stack */
+		push_frame_undo(screen->current_vscreen); /* save for undo */
 
 		/*
 		 * XXX save the failure of each frestore and display it in case
@@ -5499,8 +6194,6 @@ cmd_sdump(int interactive, struct cmdarg **args)
 static cmdret *
 set_maxundos(struct cmdarg **args)
 {
-	rp_frame_undo *cur;
-
 	if (args[0] == NULL)
 		return cmdret_new(RET_SUCCESS, "%d", defaults.maxundos);
 
@@ -5511,11 +6204,8 @@ set_maxundos(struct cmdarg **args)
 	defaults.maxundos = ARG(0, number);
 
 	/* Delete any superfluous undos */
-	while (list_size(&rp_frame_undos) > defaults.maxundos) {
-		/* Delete the oldest node */
-		list_last(cur, &rp_frame_undos, node);
-		del_frame_undo(cur);
-	}
+	frame_undo_resize(&frame_undos, defaults.maxundos);
+	frame_undo_resize(&frame_redos, defaults.maxundos);
 
 	return cmdret_new(RET_SUCCESS, NULL);
 }
@@ -5671,33 +6361,31 @@ cmd_iother(int interactive, struct cmdarg **args)
 cmdret *
 cmd_undo(int interactive, struct cmdarg **args)
 {
-	rp_frame_undo *cur;
+	rp_frame_undo cur;
+	cmdret *ret;
 
-	cur = pop_frame_undo();
-	if (!cur)
+	if (!pop_frame_undo(&cur))
 		return cmdret_new(RET_FAILURE,
 		    "No more undo information available");
-	else {
-		cmdret *ret;
 
-		ret = frestore(cur->frames, cur->vscreen);
-		return ret;
-	}
+	ret = frestore_undo(&cur);
+	frame_undo_free(&cur);
+	return ret;
 }
 
 cmdret *
 cmd_redo(int interactive, struct cmdarg **args)
 {
-	rp_frame_undo *cur;
+	rp_frame_undo cur;
 	cmdret *ret;
 
 	/* The current layout goes on the undo. */
-	cur = pop_frame_redo();
-	if (!cur)
+	if (!pop_frame_redo(&cur))
 		return cmdret_new(RET_FAILURE,
 		    "No more redo information available");
 
-	ret = frestore(cur->frames, cur->vscreen);
+	ret = frestore_undo(&cur);
+	frame_undo_free(&cur);
 	return ret;
 }
 
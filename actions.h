@@ -35,6 +35,7 @@ rp_keymap *find_keymap(char *name);
 void init_user_commands(void);
 void initialize_default_keybindings(void);
 cmdret *command(int interactive, char *data);
+cmdret *command_action(int interactive, rp_action *action);
 cmdret *cmdret_new(int success, char *fmt,...);
 void cmdret_free(cmdret *ret);
 void free_user_commands(void);
@@ -28,7 +28,6 @@
 #include <unistd.h>
 #include <errno.h>
 #include <err.h>
-#include <sys/time.h>
 
 #include "sdorfehs.h"
 
@@ -53,7 +52,11 @@ static struct sbuf *bar_line = NULL;
 struct list_head bar_chunks;
 static char *last_bar_line;
 static char *last_bar_window_fmt;
-static char bar_tmp_line[256];
+static int last_bar_width;
+static int last_bar_text_width;
+static char bar_tmp_line[4096];
+static int bar_line_pending = 0;
+static long long bar_last_redraw;
 static Pixmap bar_pm;
 
 struct bar_chunk {
@@ -64,6 +67,7 @@ struct bar_chunk {
 	char *clickcmd;
 	int text_x;
 	int text_width;
+	int measured;
 	struct list_head node;
 };
 
@@ -71,31 +75,51 @@ static void draw_partial_string(rp_screen *s, char *msg, int len, int x_offset,
     int y_offset, int style, char *color);
 static void marked_message_internal(char *msg, int mark_start, int mark_end,
     int bar_type);
+static void bar_timer_expired(void *arg);
+static void bar_flush_fifo(void *arg);
 
-/* Reset the alarm to auto-hide the bar in BAR_TIMEOUT seconds. */
-void
-bar_reset_alarm(void)
+static struct rp_timer bar_timer =
+    RP_TIMER_INITIALIZER(bar_timer_expired, NULL);
+static struct rp_timer bar_fifo_timer =
+    RP_TIMER_INITIALIZER(bar_flush_fifo, NULL);
+
+/* The bar timed out, so hide it. */
+static void
+bar_timer_expired(void *arg)
 {
-	struct timeval timeout;
-	struct itimerval alarmtimer;
+	rp_screen *cur;
 
-	memset(&timeout, 0, sizeof(timeout));
-	memset(&alarmtimer, 0, sizeof(alarmtimer));
+	PRINT_DEBUG(("bar timer expired\n"));
 
-	timeout.tv_sec = (time_t)(defaults.bar_timeout);
-	alarmtimer.it_value = timeout;
-	setitimer(ITIMER_REAL, &alarmtimer, NULL);
+	/* Only hide the bar if it times out. */
+	if (defaults.bar_timeout > 0) {
+		list_for_each_entry(cur, &rp_screens, node) {
+			hide_bar(cur, 0);
+		}
+	}
+}
 
-	alarm_signalled = 0;
+/* Reset the timer to auto-hide the bar in BAR_TIMEOUT seconds. */
+void
+bar_reset_alarm(void)
+{
+	if (defaults.bar_timeout > 0)
+		timer_arm(&bar_timer, defaults.bar_timeout * 1000);
+	else
+		timer_disarm(&bar_timer);
+}
+
+/* Keep the bar up until something else hides it. */
+void
+bar_cancel_alarm(void)
+{
+	timer_disarm(&bar_timer);
 }
 
 static int
 bar_time_left(void)
 {
-	struct itimerval left;
-
-	getitimer(ITIMER_REAL, &left);
-	return left.it_value.tv_sec > 0;
+	return timer_armed(&bar_timer);
 }
 
 int
@@ -279,6 +303,146 @@ update_bar(rp_screen *s)
 	}
 }
 
+static void
+bar_free_chunks(struct list_head *chunks)
+{
+	struct list_head *iter, *tmp;
+	struct bar_chunk *chunk;
+
+	list_for_each_safe_entry(chunk, iter, tmp, chunks, node) {
+		free(chunk->text);
+		if (chunk->color)
+			free(chunk->color);
+		if (chunk->font)
+			free(chunk->font);
+		if (chunk->clickcmd)
+			free(chunk->clickcmd);
+		list_del(&chunk->node);
+		free(chunk);
+	}
+}
+
+static void
+bar_add_chunk(struct list_head *chunks, char *text, char *color, char *font,
+    char *clickcmd)
+{
+	struct bar_chunk *chunk;
+
+	chunk = xmalloc(sizeof(struct bar_chunk));
+	memset(chunk, 0, sizeof(struct bar_chunk));
+	chunk->text = xstrdup(text);
+	chunk->length = strlen(chunk->text);
+	chunk->color = color ? xstrdup(color) : NULL;
+	chunk->font = font ? xstrdup(font) : NULL;
+	chunk->clickcmd = clickcmd ? xstrdup(clickcmd) : NULL;
+	list_add_tail(&chunk->node, chunks);
+}
+
+static int
+bar_str_equal(char *a, char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+static int
+bar_chunk_equal(struct bar_chunk *a, struct bar_chunk *b)
+{
+	return a->length == b->length && strcmp(a->text, b->text) == 0 &&
+	    bar_str_equal(a->color, b->color) &&
+	    bar_str_equal(a->font, b->font) &&
+	    bar_str_equal(a->clickcmd, b->clickcmd);
+}
+
+/*
+ * Split a bar line into chunks of text sharing the same color, font and click
+ * command.  Runs of plain characters are copied in one go.
+ */
+static void
+bar_parse_chunks(char *line, struct list_head *chunks)
+{
+	struct sbuf *curcmd, *curtxt, *cur;
+	char *tline, *font, *color, *clickcmd;
+	int len, x, run, cmd = 0;
+
+	curcmd = sbuf_new(0);
+	curtxt = sbuf_new(0);
+	color = font = clickcmd = NULL;
+
+	len = strlen(line);
+	x = 0;
+	while (x < len) {
+		cur = cmd ? curcmd : curtxt;
+
+		for (run = x; x < len; x++)
+			if (line[x] == '\\' || line[x] == (cmd ? ')' : '^'))
+				break;
+		sbuf_nconcat(cur, line + run, x - run);
+		if (x == len)
+			break;
+
+		if (line[x] == '\\') {
+			/* take the next character literally */
+			if (x + 1 < len)
+				sbuf_nconcat(cur, line + x + 1, 1);
+			x += 2;
+			continue;
+		}
+		x++;
+
+		if (!cmd) {
+			cmd = 1;
+			bar_add_chunk(chunks, sbuf_get(curtxt), color, font,
+			    clickcmd);
+			sbuf_clear(curtxt);
+			continue;
+		}
+
+		tline = sbuf_get(curcmd);
+		if (strncmp(tline, "fg(", 3) == 0) {
+			/* ^fg(green)text^fg() */
+			if (color)
+				free(color);
+			color = NULL;
+			if (strlen(tline) > 3)
+				color = xstrdup(tline + 3);
+		} else if (strncmp(tline, "fn(", 3) == 0) {
+			/* ^fn(courier)text^fn() */
+			if (font)
+				free(font);
+			font = NULL;
+			if (strlen(tline) > 3)
+				font = xstrdup(tline + 3);
+		} else if (strncmp(tline, "ca(", 3) == 0) {
+			/* ^ca(1,some command)*^ca() */
+			if (clickcmd)
+				free(clickcmd);
+			clickcmd = NULL;
+			if (strlen(tline) > 4)
+				clickcmd = xstrdup(tline + 3);
+		} else {
+			PRINT_DEBUG(("unsupported bar command \"%s\", "
+			    "ignoring\n", tline));
+		}
+		sbuf_clear(curcmd);
+		cmd = 0;
+	}
+
+	tline = sbuf_get(curtxt);
+	if (strlen(tline))
+		bar_add_chunk(chunks, tline, color, font, clickcmd);
+
+	sbuf_free(curcmd);
+	sbuf_free(curtxt);
+	if (color)
+		free(color);
+	if (font)
+		free(font);
+	if (clickcmd)
+		free(clickcmd);
+}
+
 /*
  * To avoid having to parse the bar line text and redraw text over and over
  * again, text is drawn on a pixmap in two lines.  When the window format text
@@ -290,12 +454,11 @@ void
 redraw_sticky_bar_text(int force)
 {
 	rp_screen *s = screen_primary();
-	struct list_head *iter, *tmp;
-	struct bar_chunk *chunk;
-	struct sbuf *tbuf, *curcmd, *curtxt;
-	char *tline, *font, *color, *clickcmd;
-	int diff = 0, len, cmd = 0, skip = 0, xftx = 0, x;
-	int width, height;
+	struct list_head chunks, *o, *n;
+	struct bar_chunk *chunk, *old;
+	struct sbuf *tbuf;
+	int diff = 0, xftx = 0, x, same, prefix, suffix;
+	int damage_x, damage_end, width, height;
 
 	if (!defaults.bar_sticky || (!force && (s->full_screen_win ||
 	    bar_time_left())))
@@ -316,6 +479,7 @@ redraw_sticky_bar_text(int force)
 	    width, height);
 
 	if (force) {
+		rp_uncache_draw(bar_pm);
 		XFreePixmap(dpy, bar_pm);
 		XClearWindow(dpy, s->bar_window);
 		bar_pm = XCreatePixmap(dpy, s->bar_window, width,
@@ -355,123 +519,107 @@ redraw_sticky_bar_text(int force)
 
 	diff = (last_bar_line == NULL ||
 	    strcmp(last_bar_line, sbuf_get(bar_line)) != 0);
+	if (width != last_bar_width)
+		force = 1;
 	if (!diff && !force)
-		goto redraw_bar_text;
+		goto copy_bar_text;
 
 	PRINT_DEBUG(("recalculating bar chunks\n"));
 
 	if (last_bar_line)
 		free(last_bar_line);
 	last_bar_line = xstrdup(sbuf_get(bar_line));
-	len = strlen(last_bar_line);
 
-	curcmd = sbuf_new(0);
-	curtxt = sbuf_new(0);
+	INIT_LIST_HEAD(&chunks);
+	bar_parse_chunks(last_bar_line, &chunks);
 
-	list_for_each_safe_entry(chunk, iter, tmp, &bar_chunks, node) {
-		free(chunk->text);
-		if (chunk->color)
-			free(chunk->color);
-		if (chunk->font)
-			free(chunk->font);
-		if (chunk->clickcmd)
-			free(chunk->clickcmd);
-		list_del(&chunk->node);
-		free(chunk);
-	}
-
-	color = font = clickcmd = NULL;
-	for (x = 0; x < len; x++) {
-		if (last_bar_line[x] == '\\' && !skip) {
-			skip = 1;
-			continue;
+	/*
+	 * Chunks are drawn left to right from the middle of the pixmap's
+	 * second line.  Only the chunks between the unchanged ones at either
+	 * end need measuring, and unless the total width changed, only they
+	 * need repainting.  A forced redraw starts over from scratch, since
+	 * the pixmap is new and the font may have changed.
+	 */
+	prefix = suffix = 0;
+	if (!force) {
+		same = list_size(&bar_chunks);
+		if (list_size(&chunks) < same)
+			same = list_size(&chunks);
+
+		o = bar_chunks.next;
+		n = chunks.next;
+		for (; same > 0; same--, o = o->next, n = n->next) {
+			old = list_entry(o, struct bar_chunk, node);
+			chunk = list_entry(n, struct bar_chunk, node);
+			if (!bar_chunk_equal(old, chunk))
+				break;
+			chunk->text_width = old->text_width;
+			chunk->measured = 1;
+			prefix += chunk->text_width;
 		}
 
-		if (cmd) {
-			if (last_bar_line[x] == ')' && !skip) {
-				tline = sbuf_get(curcmd);
-				if (strncmp(tline, "fg(", 3) == 0) {
-					/* ^fg(green)text^fg() */
-					if (color)
-						free(color);
-					color = NULL;
-					if (strlen(tline) > 3)
-						color = xstrdup(tline + 3);
-				} else if (strncmp(tline, "fn(", 3) == 0) {
-					/* ^fn(courier)text^fn() */
-					if (font)
-						free(font);
-					font = NULL;
-					if (strlen(tline) > 3)
-						font = xstrdup(tline + 3);
-				} else if (strncmp(tline, "ca(", 3) == 0) {
-					/* ^ca(1,some command)*^ca() */
-					if (clickcmd)
-						free(clickcmd);
-					clickcmd = NULL;
-					if (strlen(tline) > 4)
-						clickcmd = xstrdup(tline + 3);
-				} else {
-					PRINT_DEBUG(("unsupported bar command "
-					    "\"%s\", ignoring\n", tline));
-				}
-				sbuf_clear(curcmd);
-				cmd = 0;
-			} else
-				sbuf_nconcat(curcmd, last_bar_line + x, 1);
-		} else if (last_bar_line[x] == '^' && !skip) {
-			cmd = 1;
-			chunk = xmalloc(sizeof(struct bar_chunk));
-			memset(chunk, 0, sizeof(struct bar_chunk));
-			chunk->text = xstrdup(sbuf_get(curtxt));
-			chunk->length = strlen(chunk->text);
-			chunk->color = color ? xstrdup(color) : NULL;
-			chunk->font = font ? xstrdup(font) : NULL;
-			chunk->clickcmd = clickcmd ? xstrdup(clickcmd) : NULL;
-			list_add_tail(&chunk->node, &bar_chunks);
-			sbuf_clear(curtxt);
-		} else {
-			sbuf_nconcat(curtxt, last_bar_line + x, 1);
+		o = bar_chunks.prev;
+		n = chunks.prev;
+		for (; same > 0; same--, o = o->prev, n = n->prev) {
+			old = list_entry(o, struct bar_chunk, node);
+			chunk = list_entry(n, struct bar_chunk, node);
+			if (!bar_chunk_equal(old, chunk))
+				break;
+			chunk->text_width = old->text_width;
+			chunk->measured = 1;
+			suffix += chunk->text_width;
 		}
-
-		skip = 0;
-	}
-	tline = sbuf_get(curtxt);
-	if (strlen(tline)) {
-		chunk = xmalloc(sizeof(struct bar_chunk));
-		memset(chunk, 0, sizeof(struct bar_chunk));
-		chunk->text = xstrdup(sbuf_get(curtxt));
-		chunk->length = strlen(chunk->text);
-		chunk->color = color ? xstrdup(color) : NULL;
-		chunk->font = font ? xstrdup(font) : NULL;
-		chunk->clickcmd = clickcmd ? xstrdup(clickcmd) : NULL;
-		list_add_tail(&chunk->node, &bar_chunks);
 	}
-	sbuf_free(curcmd);
-	sbuf_free(curtxt);
-	if (color)
-		free(color);
-	if (font)
-		free(font);
-	if (clickcmd)
-		free(clickcmd);
 
-redraw_bar_text:
-	XFillRectangle(dpy, bar_pm, s->inverse_gc, 0, FONT_HEIGHT(s), s->width,
-	    FONT_HEIGHT(s));
+	bar_free_chunks(&bar_chunks);
+	list_splice_init(&chunks, &bar_chunks);
+
 	xftx = 0;
 	list_for_each_entry(chunk, &bar_chunks, node) {
-		rp_draw_string(s, bar_pm, STYLE_NORMAL,
-		    (width / 2) + xftx,
-	    	    FONT_HEIGHT(s) + FONT_ASCENT(s),
-		    chunk->text, chunk->length,
-		    chunk->font ? chunk->font : NULL,
-		    chunk->color ? chunk->color : NULL);
-
-		xftx += (chunk->text_width = rp_text_width(s, chunk->text,
-		    chunk->length, chunk->font));
+		if (!chunk->measured) {
+			chunk->text_width = rp_text_width(s, chunk->text,
+			    chunk->length, chunk->font);
+			chunk->measured = 1;
+		}
+		xftx += chunk->text_width;
+	}
+
+	if (force) {
+		damage_x = 0;
+		damage_end = s->width;
+	} else {
+		damage_x = (width / 2) + prefix;
+		if (xftx == last_bar_text_width)
+			damage_end = (width / 2) + xftx - suffix;
+		else if (xftx > last_bar_text_width)
+			damage_end = (width / 2) + xftx;
+		else
+			damage_end = (width / 2) + last_bar_text_width;
+	}
+	last_bar_text_width = xftx;
+	last_bar_width = width;
+
+	if (damage_end > damage_x) {
+		PRINT_DEBUG(("repainting bar text from %d to %d\n", damage_x,
+		    damage_end));
+
+		XFillRectangle(dpy, bar_pm, s->inverse_gc, damage_x,
+		    FONT_HEIGHT(s), damage_end - damage_x, FONT_HEIGHT(s));
+
+		x = width / 2;
+		list_for_each_entry(chunk, &bar_chunks, node) {
+			if (x >= damage_x && x < damage_end)
+				rp_draw_string(s, bar_pm, STYLE_NORMAL, x,
+				    FONT_HEIGHT(s) + FONT_ASCENT(s),
+				    chunk->text, chunk->length, chunk->font,
+				    chunk->color);
+			x += chunk->text_width;
+		}
 	}
 
+copy_bar_text:
+	xftx = last_bar_text_width;
+
 	/* update each chunk's text_x relative to its final location */
 	x = 0;
 	list_for_each_entry(chunk, &bar_chunks, node) {
@@ -1078,10 +1226,14 @@ bar_read_fifo(void)
 				start = x + 1;
 				break;
 			} else if (bar_tmp_line[x] == '\n') {
+				/*
+				 * Only the latest complete line matters, it
+				 * gets drawn by bar_flush_fifo.
+				 */
 				sbuf_nconcat(bar_buf, bar_tmp_line + start,
 				    x - start);
 				sbuf_copy(bar_line, sbuf_get(bar_buf));
-				redraw_sticky_bar_text(0);
+				bar_line_pending = 1;
 				sbuf_clear(bar_buf);
 				start = x + 1;
 			}
@@ -1090,4 +1242,35 @@ bar_read_fifo(void)
 		if (x == ret)
 			sbuf_nconcat(bar_buf, bar_tmp_line + start, x - start);
 	}
+
+	bar_flush_fifo(NULL);
+}
+
+/*
+ * Draw the last line read from the FIFO, unless the bar was already redrawn
+ * for a line less than a frame ago.  In that case, come back once the frame
+ * is over.
+ */
+static void
+bar_flush_fifo(void *arg)
+{
+	long long now, interval;
+
+	if (!bar_line_pending)
+		return;
+
+	now = timer_now();
+	if (defaults.bar_max_fps > 0) {
+		interval = 1000 / defaults.bar_max_fps;
+		if (now - bar_last_redraw < interval) {
+			if (!timer_armed(&bar_fifo_timer))
+				timer_arm(&bar_fifo_timer,
+				    interval - (now - bar_last_redraw));
+			return;
+		}
+	}
+
+	bar_line_pending = 0;
+	bar_last_redraw = now;
+	redraw_sticky_bar_text(0);
 }
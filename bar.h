@@ -23,6 +23,7 @@
 int bar_mkfifo(void);
 void init_bar(void);
 void bar_reset_alarm(void);
+void bar_cancel_alarm(void);
 void redraw_sticky_bar_text(int force);
 void update_window_names(rp_screen *s, char *fmt);
 void update_vscreen_names(rp_screen *s);
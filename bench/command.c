@@ -0,0 +1,98 @@
+/*
+ * Cost of dispatching a command.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Time command() for a plain command, an alias, a variable read through set
+ * and an unknown name, with the real command and variable tables plus a few
+ * hundred user aliases loaded.  The commands used don't touch the display,
+ * so this is linked against everything but main() and needs no X server.
+ *
+ * usage: bench/command [iterations]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sdorfehs.h"
+
+#define ALIASES	300
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(const char *what, char **cmds, int ncmds, int iterations)
+{
+	cmdret *ret;
+	double start;
+	int i;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		ret = command(0, cmds[i % ncmds]);
+		if (ret)
+			cmdret_free(ret);
+	}
+
+	printf("  %-22s %8.1f ns/command\n", what,
+	    (now() - start) / iterations * 1e9);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *version[] = { "version" };
+	char *set[] = { "set historysize" };
+	char *unknown[] = { "nosuchcommand" };
+	char *aliases[ALIASES], *define;
+	cmdret *ret;
+	int i, iterations = 1000000;
+
+	if (argc > 1 && (iterations = atoi(argv[1])) < 1)
+		errx(1, "usage: %s [iterations]", argv[0]);
+
+	/* What main() sets up before running commands, minus the display. */
+	defaults.top_kmap = xstrdup(TOP_KEYMAP);
+	init_user_commands();
+	initialize_default_keybindings();
+
+	for (i = 0; i < ALIASES; i++) {
+		aliases[i] = xsprintf("benchalias%d", i);
+		define = xsprintf("alias %s version", aliases[i]);
+		if ((ret = command(0, define)) == NULL || !ret->success)
+			errx(1, "%s failed", define);
+		cmdret_free(ret);
+		free(define);
+	}
+
+	printf("%d calls to command() each\n", iterations);
+	run("command", version, 1, iterations);
+	run("alias", aliases, ALIASES, iterations);
+	run("set variable", set, 1, iterations);
+	run("unknown name", unknown, 1, iterations);
+
+	return 0;
+}
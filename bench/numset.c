@@ -0,0 +1,96 @@
+/*
+ * Cost of allocating and releasing numbers from a numset.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * For sets of a few hundred up to tens of thousands of numbers, time filling
+ * the set with numset_request, then releasing a random number and requesting
+ * one again, which must hand the same number back, and finally releasing
+ * every number.
+ *
+ * usage: bench/numset [churn iterations]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "number.h"
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run(int size, int churn)
+{
+	struct numset *ns;
+	double start, fill, cycle, release;
+	int i, n, got;
+
+	ns = numset_new();
+
+	start = now();
+	for (i = 0; i < size; i++)
+		if ((got = numset_request(ns)) != i)
+			errx(1, "request %d returned %d", i, got);
+	fill = now() - start;
+
+	srandom(size);
+	start = now();
+	for (i = 0; i < churn; i++) {
+		n = random() % size;
+		numset_release(ns, n);
+		if ((got = numset_request(ns)) != n)
+			errx(1, "released %d but got %d back", n, got);
+	}
+	cycle = now() - start;
+
+	start = now();
+	for (i = 0; i < size; i++)
+		numset_release(ns, i);
+	release = now() - start;
+
+	if ((got = numset_request(ns)) != 0)
+		errx(1, "empty set returned %d", got);
+	numset_free(ns);
+
+	printf("  %6d numbers: %7.1f ns/request, %7.1f ns/release+request, "
+	    "%7.1f ns/release\n", size, fill / size * 1e9,
+	    cycle / churn * 1e9, release / size * 1e9);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int churn = 1000000;
+
+	if (argc > 1 && (churn = atoi(argv[1])) < 1)
+		errx(1, "usage: %s [churn iterations]", argv[0]);
+
+	run(200, churn);
+	run(2000, churn);
+	run(20000, churn);
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Time it takes sdorfehs to adopt existing windows on restart.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Create a number of client windows, start sdorfehs on them and restart it a
+ * few times, timing from each restart command until every window is managed
+ * again, which covers scanwins and adopting each window.  Run it on an X
+ * server with no window manager, for example:
+ *
+ *	Xvfb :9 & DISPLAY=:9 bench/restart -n 400
+ *
+ * To see the cost of a remote connection, point DISPLAY at a server behind
+ * an ssh tunnel or a network delay instead.
+ *
+ * usage: bench/restart [-n windows] [-r restarts] [-s path/to/sdorfehs]
+ */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include <sys/wait.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *sdorfehs = "./sdorfehs";
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+pause_briefly(void)
+{
+	struct timespec ts = { 0, 1000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+static void
+create_windows(Display *dpy, int n)
+{
+	XClassHint class = { "bench", "Bench" };
+	XSizeHints hints;
+	Window w;
+	char name[32];
+	int i;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.flags = PMinSize;
+	hints.min_width = hints.min_height = 10;
+
+	for (i = 0; i < n; i++) {
+		w = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0,
+		    200, 100, 0, 0, 0);
+		snprintf(name, sizeof(name), "bench window %d", i);
+		XStoreName(dpy, w, name);
+		XSetClassHint(dpy, w, &class);
+		XSetWMNormalHints(dpy, w, &hints);
+		XMapWindow(dpy, w);
+	}
+	XSync(dpy, False);
+}
+
+/*
+ * Run sdorfehs -c cmd and return the number of output lines starting with a
+ * digit, or -1 if it failed.
+ */
+static int
+client(const char *cmd)
+{
+	FILE *f;
+	char line[256];
+	pid_t pid;
+	int fds[2], status, lines = 0;
+
+	if (pipe(fds) == -1)
+		err(1, "pipe");
+
+	switch ((pid = fork())) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		if ((fds[1] = open("/dev/null", O_WRONLY)) != -1)
+			dup2(fds[1], STDERR_FILENO);
+		execl(sdorfehs, sdorfehs, "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	if ((f = fdopen(fds[0], "r")) == NULL)
+		err(1, "fdopen");
+	while (fgets(line, sizeof(line), f))
+		if (line[0] >= '0' && line[0] <= '9')
+			lines++;
+	fclose(f);
+
+	if (waitpid(pid, &status, 0) == -1)
+		err(1, "waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+
+	return lines;
+}
+
+/* Wait until sdorfehs answers and manages all n windows. */
+static void
+wait_for_windows(int n)
+{
+	double give_up = now() + 60;
+
+	while (client("windows %n") != n) {
+		if (now() > give_up)
+			errx(1, "sdorfehs didn't manage %d windows within a "
+			    "minute", n);
+		pause_briefly();
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	Display *dpy;
+	char home[] = "/tmp/sdorfehs-restart.XXXXXX";
+	double start, first, total = 0;
+	pid_t wm;
+	int c, i, windows = 400, restarts = 10;
+
+	while ((c = getopt(argc, argv, "n:r:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			windows = atoi(optarg);
+			break;
+		case 'r':
+			restarts = atoi(optarg);
+			break;
+		case 's':
+			sdorfehs = optarg;
+			break;
+		default:
+			errx(1, "usage: %s [-n windows] [-r restarts] "
+			    "[-s sdorfehs]", argv[0]);
+		}
+	}
+	if (windows < 1 || restarts < 1)
+		errx(1, "bad number of windows or restarts");
+
+	if (!(dpy = XOpenDisplay(NULL)))
+		errx(1, "can't open display");
+
+	/* Keep the user's configuration, history and socket out of this. */
+	if (mkdtemp(home) == NULL)
+		err(1, "mkdtemp");
+	setenv("HOME", home, 1);
+
+	create_windows(dpy, windows);
+
+	start = now();
+	switch ((wm = fork())) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		close(ConnectionNumber(dpy));
+		execl(sdorfehs, sdorfehs, (char *)NULL);
+		err(1, "%s", sdorfehs);
+	}
+	wait_for_windows(windows);
+	first = now() - start;
+
+	for (i = 0; i < restarts; i++) {
+		/*
+		 * Aliases don't survive a restart, so this one tells the old
+		 * process, which still manages every window, from the new one.
+		 */
+		if (client("alias benchrestart version") == -1)
+			errx(1, "couldn't define an alias");
+
+		start = now();
+		client("restart");
+		while (client("benchrestart") != -1)
+			pause_briefly();
+		wait_for_windows(windows);
+		total += now() - start;
+	}
+
+	client("quit");
+	waitpid(wm, NULL, 0);
+	XCloseDisplay(dpy);
+
+	printf("%d windows, sdorfehs ran with HOME=%s\n", windows, home);
+	printf("  first start:     %8.1f ms\n", first * 1e3);
+	printf("  restart:         %8.1f ms (average of %d)\n",
+	    total / restarts * 1e3, restarts);
+
+	return 0;
+}
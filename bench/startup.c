@@ -0,0 +1,128 @@
+/*
+ * Startup latency of the -c command client.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Run "sdorfehs -c command" a number of times against a running sdorfehs,
+ * once as is and once with the X setup the client used to do first (locale
+ * modifiers, opening the display and interning three atoms), and print the
+ * average wall time of each.
+ *
+ * usage: bench/startup [-n runs] [-s path/to/sdorfehs] [command]
+ */
+
+#include <X11/Xlib.h>
+
+#include <sys/wait.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+connect_like_before(void)
+{
+	Display *dpy;
+
+	if (XSupportsLocale())
+		XSetLocaleModifiers("");
+	if (!(dpy = XOpenDisplay(NULL)))
+		errx(1, "can't open display");
+	XInternAtom(dpy, "RP_SELECTION", False);
+	XInternAtom(dpy, "COMPOUND_TEXT", False);
+	XInternAtom(dpy, "UTF8_STRING", False);
+	XCloseDisplay(dpy);
+}
+
+static double
+run(const char *sdorfehs, const char *cmd, int runs, int with_x)
+{
+	double start;
+	pid_t pid;
+	int i, fd, status;
+
+	start = now();
+	for (i = 0; i < runs; i++) {
+		switch ((pid = fork())) {
+		case -1:
+			err(1, "fork");
+		case 0:
+			if ((fd = open("/dev/null", O_WRONLY)) != -1)
+				dup2(fd, STDOUT_FILENO);
+			if (with_x)
+				connect_like_before();
+			execl(sdorfehs, sdorfehs, "-c", cmd, (char *)NULL);
+			err(1, "%s", sdorfehs);
+		}
+		if (waitpid(pid, &status, 0) == -1)
+			err(1, "waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			errx(1, "%s -c \"%s\" failed, is sdorfehs running?",
+			    sdorfehs, cmd);
+	}
+
+	return (now() - start) / runs;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *sdorfehs = "./sdorfehs", *cmd = "version";
+	double without, with;
+	int c, runs = 500;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 's':
+			sdorfehs = optarg;
+			break;
+		default:
+			errx(1, "usage: %s [-n runs] [-s sdorfehs] [command]",
+			    argv[0]);
+		}
+	}
+	if (optind < argc)
+		cmd = argv[optind];
+	if (runs < 1)
+		errx(1, "bad number of runs");
+
+	/* Warm up the caches before either measurement. */
+	run(sdorfehs, cmd, 10, 1);
+
+	without = run(sdorfehs, cmd, runs, 0);
+	with = run(sdorfehs, cmd, runs, 1);
+
+	printf("%d runs of %s -c \"%s\"\n", runs, sdorfehs, cmd);
+	printf("  without X:       %8.1f us/run\n", without * 1e6);
+	printf("  with X setup:    %8.1f us/run\n", with * 1e6);
+
+	return 0;
+}
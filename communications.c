@@ -26,7 +26,9 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <err.h>
 #include <errno.h>
@@ -36,6 +38,65 @@
 
 #define BUFSZ 1024
 
+/*
+ * A client sending CONTROL_FRAMED as its first byte keeps its connection open
+ * and talks in frames: a 4 byte big-endian length followed by that many bytes
+ * of payload.  A request's payload is a 4 byte tag, a byte with the
+ * interactive flag and the command.  Each reply carries the tag of its
+ * request, a byte with the exit status and the output of the command.
+ * Requests are executed in order, so a client may pipeline as many as it
+ * likes.
+ */
+#define CONTROL_FRAMED	0x80
+#define FRAME_HDR_LEN	4
+#define FRAME_TAG_LEN	4
+#define FRAME_MAX_LEN	(1024 * 1024)
+
+/*
+ * A framed client may send "subscribe [event ...]" to have a frame tagged
+ * EVENT_TAG pushed to it every time one of the named hook events (or any of
+ * them if none are named) happens, and "unsubscribe" to stop that.  Events are
+ * dropped on the floor for subscribers that let more than
+ * MAX_EVENT_BACKLOG bytes pile up.
+ */
+#define EVENT_TAG		0xffffffffUL
+#define MAX_EVENT_BACKLOG	(256 * 1024)
+
+enum control_mode {
+	/* Nothing received yet. */
+	CONTROL_MODE_UNKNOWN,
+
+	/* A single command terminated by a NUL, then we hang up. */
+	CONTROL_MODE_ONESHOT,
+
+	/* Framed requests and replies until the client hangs up. */
+	CONTROL_MODE_FRAMED,
+};
+
+struct control_client {
+	int fd;
+	enum control_mode mode;
+
+	/* Bytes received but not yet handled, and not yet written. */
+	struct sbuf *in, *out;
+
+	/* Set when the connection is to be closed once out is written. */
+	int closing;
+
+	/* Set when the connection is to be closed right away. */
+	int dead;
+
+	/* When the client times out, 0 if it is idle and can't. */
+	time_t expires;
+
+	/* Bit mask of the rp_hook_db events the client subscribed to. */
+	unsigned long events;
+
+	struct list_head node;
+};
+
+static LIST_HEAD(control_clients);
+
 void
 init_control_socket_path(void)
 {
@@ -75,7 +136,7 @@ listen_for_commands(void)
 	if (chmod(rp_glob_screen.control_socket_path, 0600) == -1)
 		err(1, "chmod %s", rp_glob_screen.control_socket_path);
 
-	if (listen(rp_glob_screen.control_socket_fd, 2) == -1)
+	if (listen(rp_glob_screen.control_socket_fd, SOMAXCONN) == -1)
 		err(1, "listen %s", rp_glob_screen.control_socket_path);
 
 	PRINT_DEBUG(("listening for commands at %s\n",
@@ -85,13 +146,9 @@ listen_for_commands(void)
 static ssize_t
 recv_unix(int fd, char **callerbuf)
 {
-	int firstloop;
 	char *message;
 	ssize_t len, count;
 
-	int flags = 0x0;
-	int retries = 0;
-
 #ifdef SENDCMD_DEBUG
 	pid_t pid = getpid();
 	char *dpfx = xsprintf("recv_unix_%d", pid);
@@ -102,57 +159,24 @@ recv_unix(int fd, char **callerbuf)
 	memset(message, 0, BUFSZ);
 
 	len = 0;
-	firstloop = 1;
 
-	while ((count = recv(fd, message + len, BUFSZ, flags))) {
+	/* The reply is complete once the server closes the connection. */
+	while ((count = recv(fd, message + len, BUFSZ, 0))) {
 		if (count == -1) {
-			switch (errno) {
-			/*
-			 * message is complete
-			 */
-			case ECONNRESET: /* sender finished and closed */
-			case EAGAIN:     /* no more left to read */
-				WARNX_DEBUG("%s: done: e%d\n", dpfx, errno);
-				break;
-			/*
-			 * transient conditions for retrying
-			 */
-			case ECONNREFUSED:
-			case ENOMEM:
-				if (retries++ >= 5) {
-					warn("recv_unix: retries exhausted");
-					len = -1;
-					break;
-				}
-				usleep(200);
-				/* fallthrough */
-			case EINTR:
-				warn("recv_unix: trying again");
+			if (errno == EINTR)
 				continue;
-			/*
-			 * usage error or untenable situation:
-			 * EBADF, EFAULT, EINVAL, ENOTCONN, ENOTSOCK
-			 */
-			default:
-				warn("unanticipated receive error");
-				len = -1;
-			}
+			/* sender finished and closed */
+			if (errno == ECONNRESET)
+				break;
+
+			warn("unanticipated receive error");
+			len = -1;
 			break;
 		}
-		if (firstloop) {
-			WARNX_DEBUG("%s: first recv: %zd\n", dpfx, count);
-			/*
-			 * after blocking for the first buffer, we can
-			 * keep reading until it blocks again, which
-			 * should exhaust the message.
-			 */
-			flags += MSG_DONTWAIT;
-		}
 		len += count;
 		message = xrealloc(message, len + BUFSZ);
 		memset(message + len, 0, BUFSZ);
 		WARNX_DEBUG("%s: looping after count %zd\n", dpfx, count);
-		firstloop = 0;
 	}
 #ifdef SENDCMD_DEBUG
 	free(dpfx);
@@ -183,10 +207,66 @@ send_unix(int fd, char *buf, ssize_t sz)
 	return off;
 }
 
+static void
+put_be32(unsigned char *p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static unsigned long
+get_be32(const unsigned char *p)
+{
+	return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+	    ((unsigned long)p[2] << 8) | (unsigned long)p[3];
+}
+
+/* Append a frame holding tag, a status/flag byte and len bytes of data. */
+static void
+frame_append(struct sbuf *b, unsigned long tag, int flag, const char *data,
+    size_t len)
+{
+	unsigned char hdr[FRAME_HDR_LEN + FRAME_TAG_LEN + 1];
+
+	put_be32(hdr, FRAME_TAG_LEN + 1 + len);
+	put_be32(hdr + FRAME_HDR_LEN, tag);
+	hdr[FRAME_HDR_LEN + FRAME_TAG_LEN] = (unsigned char)flag;
+
+	sbuf_nconcat(b, (char *)hdr, sizeof(hdr));
+	if (len)
+		sbuf_nconcat(b, data, len);
+}
+
+static int
+control_connect(void)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+
+	if (strlen(rp_glob_screen.control_socket_path) >= sizeof(sun.sun_path))
+		err(1, "control socket path too long: %s",
+		    rp_glob_screen.control_socket_path);
+
+	strncpy(sun.sun_path, rp_glob_screen.control_socket_path,
+	    sizeof(sun.sun_path)-1);
+	sun.sun_path[sizeof(sun.sun_path) - 1] = '\0';
+	sun.sun_family = AF_UNIX;
+
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		err(1, "failed to connect to control socket at %s",
+		    rp_glob_screen.control_socket_path);
+
+	return fd;
+}
+
 int
 send_command(int interactive, char *cmd)
 {
-	struct sockaddr_un sun;
 	char *wcmd, *response;
 	char success = 0;
 	ssize_t len;
@@ -204,21 +284,7 @@ send_command(int interactive, char *cmd)
 	*wcmd = (unsigned char)interactive;
 	strncpy(wcmd + 1, cmd, len - 1);
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
-		err(1, "socket");
-
-	if (strlen(rp_glob_screen.control_socket_path) >= sizeof(sun.sun_path))
-		err(1, "control socket path too long: %s",
-		    rp_glob_screen.control_socket_path);
-
-	strncpy(sun.sun_path, rp_glob_screen.control_socket_path,
-	    sizeof(sun.sun_path)-1);
-	sun.sun_path[sizeof(sun.sun_path) - 1] = '\0';
-	sun.sun_family = AF_UNIX;
-
-	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
-		err(1, "failed to connect to control socket at %s",
-		    rp_glob_screen.control_socket_path);
+	fd = control_connect();
 
 	if (send_unix(fd, wcmd, len) != len)
 		err(1, "%s: aborting after bad write", __func__);
@@ -252,63 +318,623 @@ send_command(int interactive, char *cmd)
 	return success;
 }
 
-void
-receive_command(void)
+/* Print the output of a command, making sure it ends with a newline. */
+static void
+print_reply(FILE *outf, const char *output, size_t len)
 {
-	cmdret *cmd_ret;
-	char *result, *rcmd, *cmd;
-	int cl, len = 0, interactive = 0;
+	if (len == 0)
+		return;
 
-	PRINT_DEBUG(("have connection waiting on command socket\n"));
+	fwrite(output, 1, len, outf);
+	if (output[len - 1] != '\n')
+		fputc('\n', outf);
+	fflush(outf);
+}
 
-	if ((cl = accept(rp_glob_screen.control_socket_fd, NULL, NULL)) == -1) {
-		warn("accept");
-		return;
+/*
+ * Parse a subscribe or unsubscribe request into the events it names, all of
+ * them if it names none.  Returns 0 if cmd is neither request, otherwise 1
+ * and sets *msg to an error if an event is unknown.
+ */
+static int
+parse_subscription(const char *cmd, int *subscribe, unsigned long *events,
+    char **msg)
+{
+	char *copy, *word;
+	int i;
+
+	copy = xstrdup(cmd);
+	word = strtok_ws(copy);
+
+	if (word != NULL && !strcmp(word, "subscribe"))
+		*subscribe = 1;
+	else if (word != NULL && !strcmp(word, "unsubscribe"))
+		*subscribe = 0;
+	else {
+		free(copy);
+		return 0;
 	}
-	if ((fcntl(cl, F_SETFD, FD_CLOEXEC)) == -1) {
-		warn("cloexec");
-		close(cl);
-		return;
+
+	*events = 0;
+	*msg = NULL;
+	while ((word = strtok_ws(NULL)) != NULL) {
+		if ((i = hook_index(word)) == -1) {
+			*msg = xsprintf("%s: unknown event '%s'",
+			    *subscribe ? "subscribe" : "unsubscribe", word);
+			break;
+		}
+		*events |= 1UL << i;
+	}
+	free(copy);
+
+	if (*events == 0)
+		*events = ~0UL;
+
+	return 1;
+}
+
+/*
+ * Read commands, one per line, from infd and send them all over a single
+ * framed connection, printing the replies as they come in.  Returns 1 if every
+ * command succeeded.
+ */
+int
+send_command_stream(int interactive, int infd)
+{
+	struct pollfd pfd[2];
+	struct sbuf *line, *out, *in;
+	unsigned long tag = 0, next_reply = 0, flen, events, subscribed = 0;
+	char buf[BUFSZ], *nl, *cmd, *msg, framed = (char)CONTROL_FRAMED;
+	int fd, ineof = 0, subscribe, success = 1;
+	ssize_t count;
+	size_t start;
+
+	fd = control_connect();
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1)
+		err(1, "fcntl");
+
+	line = sbuf_new(0);
+	in = sbuf_new(0);
+	out = sbuf_new(0);
+	sbuf_nconcat(out, &framed, 1);
+
+	while (!ineof || out->len > 0 || next_reply < tag || subscribed) {
+		pfd[0].fd = ineof ? -1 : infd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = fd;
+		pfd[1].events = POLLIN | (out->len > 0 ? POLLOUT : 0);
+
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "poll");
+		}
+
+		if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			count = read(infd, buf, sizeof(buf));
+			if (count == -1 && errno != EINTR && errno != EAGAIN)
+				err(1, "read");
+			if (count == 0)
+				ineof = 1;
+			if (count > 0)
+				sbuf_nconcat(line, buf, count);
+
+			/* Frame every complete line, and the rest at EOF. */
+			start = 0;
+			while (start < line->len) {
+				nl = memchr(line->data + start, '\n',
+				    line->len - start);
+				if (nl == NULL && !ineof)
+					break;
+				if (nl == NULL)
+					nl = line->data + line->len;
+				if (nl > line->data + start) {
+					/*
+					 * Keep listening for as long as some
+					 * events are subscribed to.
+					 */
+					cmd = xmalloc(nl - (line->data + start)
+					    + 1);
+					memcpy(cmd, line->data + start,
+					    nl - (line->data + start));
+					cmd[nl - (line->data + start)] = '\0';
+					msg = NULL;
+					if (parse_subscription(cmd, &subscribe,
+					    &events, &msg) && msg == NULL) {
+						if (subscribe)
+							subscribed |= events;
+						else
+							subscribed &= ~events;
+					}
+					free(msg);
+					free(cmd);
+					frame_append(out, tag++, interactive,
+					    line->data + start,
+					    nl - (line->data + start));
+				}
+				start = nl - line->data + 1;
+			}
+			sbuf_consume(line, start);
+		}
+
+		if ((pfd[1].revents & POLLOUT) && out->len > 0) {
+			count = send(fd, out->data, out->len, MSG_NOSIGNAL);
+			if (count == -1 && errno != EINTR && errno != EAGAIN)
+				err(1, "%s: aborting after bad write",
+				    __func__);
+			if (count > 0)
+				sbuf_consume(out, count);
+		}
+
+		if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+			count = recv(fd, buf, sizeof(buf), 0);
+			if (count == -1 && errno != EINTR && errno != EAGAIN)
+				err(1, "recv");
+			if (count == 0) {
+				if (next_reply == tag)
+					break;
+				warnx("%s: connection closed with %lu "
+				    "replies outstanding", __func__,
+				    tag - next_reply);
+				success = 0;
+				break;
+			}
+			if (count > 0)
+				sbuf_nconcat(in, buf, count);
+
+			while (in->len >= FRAME_HDR_LEN) {
+				flen = get_be32((unsigned char *)in->data);
+				if (flen < FRAME_TAG_LEN + 1)
+					errx(1, "%s: bad reply frame",
+					    __func__);
+				if (in->len < FRAME_HDR_LEN + flen)
+					break;
+
+				if (get_be32((unsigned char *)in->data +
+				    FRAME_HDR_LEN) == EVENT_TAG) {
+					print_reply(stdout, in->data +
+					    FRAME_HDR_LEN + FRAME_TAG_LEN + 1,
+					    flen - FRAME_TAG_LEN - 1);
+					sbuf_consume(in, FRAME_HDR_LEN + flen);
+					continue;
+				}
+
+				if (get_be32((unsigned char *)in->data +
+				    FRAME_HDR_LEN) != next_reply)
+					warnx("%s: reply out of order",
+					    __func__);
+				next_reply++;
+
+				if (!in->data[FRAME_HDR_LEN + FRAME_TAG_LEN])
+					success = 0;
+				print_reply(in->data[FRAME_HDR_LEN +
+				    FRAME_TAG_LEN] ? stdout : stderr,
+				    in->data + FRAME_HDR_LEN + FRAME_TAG_LEN +
+				    1, flen - FRAME_TAG_LEN - 1);
+
+				sbuf_consume(in, FRAME_HDR_LEN + flen);
+			}
+		}
 	}
 
-	if ((len = recv_unix(cl, &cmd)) <= 1) {
-		warnx("receive_command: %s\n",
-		      (len == -1 ? "encountered error during receive"
-		                 : "received command was malformed"));
-		goto done;
+	sbuf_free(line);
+	sbuf_free(in);
+	sbuf_free(out);
+	close(fd);
+
+	return success;
+}
+
+/* Monotonic seconds, for control client timeouts. */
+static time_t
+control_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/*
+ * Whether the client owes us the rest of a request or has output waiting to
+ * be read. Only then does it have to make progress before its timeout.
+ */
+static int
+control_client_busy(struct control_client *c)
+{
+	return c->mode != CONTROL_MODE_FRAMED || c->in->len > 0 ||
+	    c->out->len > 0;
+}
+
+/* The client made progress, so restart its timeout if it still matters. */
+static void
+control_client_progress(struct control_client *c)
+{
+	c->expires = control_client_busy(c) ?
+	    control_now() + CONTROL_CLIENT_TIMEOUT : 0;
+}
+
+static void
+control_client_new(int fd)
+{
+	struct control_client *c;
+
+	c = xmalloc(sizeof(struct control_client));
+	c->fd = fd;
+	c->mode = CONTROL_MODE_UNKNOWN;
+	c->in = sbuf_new(BUFSZ);
+	c->out = sbuf_new(BUFSZ);
+	c->closing = 0;
+	c->dead = 0;
+	c->events = 0;
+	control_client_progress(c);
+	list_add_tail(&c->node, &control_clients);
+
+	PRINT_DEBUG(("new control client %d\n", fd));
+}
+
+static void
+control_client_free(struct control_client *c)
+{
+	PRINT_DEBUG(("closing control client %d\n", c->fd));
+
+	list_del(&c->node);
+	close(c->fd);
+	sbuf_free(c->in);
+	sbuf_free(c->out);
+	free(c);
+}
+
+/* Write as much of the pending output as the socket takes without blocking. */
+static void
+control_client_flush(struct control_client *c)
+{
+	ssize_t count;
+	size_t off = 0;
+
+	while (off < c->out->len) {
+		count = send(c->fd, c->out->data + off, c->out->len - off,
+		    MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (count == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				warn("control client %d: bad write", c->fd);
+				c->dead = 1;
+			}
+			break;
+		}
+		off += count;
 	}
-	if (cmd[len] != '\0') {
-		/* should not be possible, TODO remove */
-		warnx("%s\n", "last byte of sent command not null");
-		cmd[len] = '\0';
+
+	if (off > 0) {
+		sbuf_consume(c->out, off);
+		control_client_progress(c);
 	}
-	interactive = cmd[0];
-	rcmd = cmd + 1;
 
-	PRINT_DEBUG(("read %d byte(s) on command socket: %s\n", len, rcmd));
+	if (c->closing && c->out->len == 0)
+		c->dead = 1;
+}
 
-	cmd_ret = command(interactive, rcmd);
+/* Execute the one-shot command in the client's buffer, if it is complete. */
+static void
+control_client_run_oneshot(struct control_client *c, int eof)
+{
+	cmdret *cmd_ret;
+	char *end, status;
+	int interactive;
 
-	/* notify the client of any text that was returned by the command */
-	len = 2;
-	if (cmd_ret->output) {
-		result = xsprintf("%c%s", cmd_ret->success ? 1 : 0,
-		    cmd_ret->output);
-		len = 1 + strlen(cmd_ret->output) + 1;
-	} else if (cmd_ret->success)
-		result = xsprintf("%c", 1);
+	/* The first byte is the interactive flag, the command ends in NUL. */
+	if (c->in->len < 2)
+		end = NULL;
 	else
-		result = xsprintf("%c", 0);
+		end = memchr(c->in->data + 1, '\0', c->in->len - 1);
+	if (end == NULL && !eof)
+		return;
+
+	if (c->in->len <= 1) {
+		warnx("receive_command: received command was malformed");
+		c->dead = 1;
+		return;
+	}
 
+	interactive = c->in->data[0];
+
+	PRINT_DEBUG(("read %zu byte(s) on command socket: %s\n", c->in->len,
+	    c->in->data + 1));
+
+	cmd_ret = command(interactive, c->in->data + 1);
+
+	/* notify the client of any text that was returned by the command */
+	status = cmd_ret->success ? 1 : 0;
+	sbuf_nconcat(c->out, &status, 1);
+	if (cmd_ret->output)
+		sbuf_concat(c->out, cmd_ret->output);
+	sbuf_nconcat(c->out, "", 1);
 	cmdret_free(cmd_ret);
 
-	PRINT_DEBUG(("writing back %d to command client: %s", len, result + 1));
+	sbuf_clear(c->in);
+	c->closing = 1;
+}
+
+/*
+ * Handle the subscribe and unsubscribe requests of a framed client, which are
+ * about the connection rather than commands. Returns 0 if cmd is neither.
+ */
+static int
+control_client_subscribe(struct control_client *c, unsigned long tag,
+    char *cmd)
+{
+	unsigned long events;
+	char *msg;
+	int subscribe;
+
+	if (!parse_subscription(cmd, &subscribe, &events, &msg))
+		return 0;
+
+	if (msg == NULL) {
+		if (subscribe)
+			c->events |= events;
+		else
+			c->events &= ~events;
+
+		PRINT_DEBUG(("control client %d events now 0x%lx\n", c->fd,
+		    c->events));
+	}
+
+	frame_append(c->out, tag, msg == NULL, msg, msg ? strlen(msg) : 0);
+	free(msg);
+
+	return 1;
+}
+
+/* Whether any control client is subscribed to the rp_hook_db event. */
+int
+control_clients_subscribed(int event)
+{
+	struct control_client *c;
+
+	list_for_each_entry(c, &control_clients, node) {
+		if (!c->dead && (c->events & (1UL << event)))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Push the record of an rp_hook_db event to the clients subscribed to it. */
+void
+control_clients_event(int event, char *record)
+{
+	struct control_client *c;
+
+	list_for_each_entry(c, &control_clients, node) {
+		if (c->dead || c->closing || !(c->events & (1UL << event)))
+			continue;
+
+		if (c->out->len > MAX_EVENT_BACKLOG) {
+			PRINT_DEBUG(("control client %d is not keeping up, "
+			    "dropping event\n", c->fd));
+			continue;
+		}
+
+		frame_append(c->out, EVENT_TAG, 1, record, strlen(record));
+		if (!c->expires)
+			control_client_progress(c);
+		control_client_flush(c);
+	}
+}
+
+/* Execute every complete request frame the client has sent. */
+static void
+control_client_run_framed(struct control_client *c)
+{
+	cmdret *cmd_ret;
+	unsigned long flen, tag;
+	char *cmd;
+	int interactive;
+
+	while (!c->dead && c->in->len >= FRAME_HDR_LEN) {
+		flen = get_be32((unsigned char *)c->in->data);
+		if (flen < FRAME_TAG_LEN + 1 || flen > FRAME_MAX_LEN) {
+			warnx("control client %d: bad frame length %lu",
+			    c->fd, flen);
+			c->dead = 1;
+			break;
+		}
+		if (c->in->len < FRAME_HDR_LEN + flen)
+			break;
+
+		tag = get_be32((unsigned char *)c->in->data + FRAME_HDR_LEN);
+		interactive = c->in->data[FRAME_HDR_LEN + FRAME_TAG_LEN];
+		cmd = xmalloc(flen - FRAME_TAG_LEN);
+		memcpy(cmd, c->in->data + FRAME_HDR_LEN + FRAME_TAG_LEN + 1,
+		    flen - FRAME_TAG_LEN - 1);
+		cmd[flen - FRAME_TAG_LEN - 1] = '\0';
+		sbuf_consume(c->in, FRAME_HDR_LEN + flen);
+
+		PRINT_DEBUG(("control client %d: command %lu: %s\n", c->fd,
+		    tag, cmd));
+
+		if (control_client_subscribe(c, tag, cmd)) {
+			free(cmd);
+			continue;
+		}
+
+		cmd_ret = command(interactive, cmd);
+		free(cmd);
+
+		frame_append(c->out, tag, cmd_ret->success ? 1 : 0,
+		    cmd_ret->output, cmd_ret->output ?
+		    strlen(cmd_ret->output) : 0);
+		cmdret_free(cmd_ret);
+	}
+}
+
+static void
+control_client_read(struct control_client *c)
+{
+	char buf[BUFSZ];
+	ssize_t count;
+	int eof = 0, got = 0;
+
+	for (;;) {
+		count = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (count > 0) {
+			sbuf_nconcat(c->in, buf, count);
+			got = 1;
+			continue;
+		}
+		if (count == -1 && errno == EINTR)
+			continue;
+		if (count == 0)
+			eof = 1;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			warn("control client %d: bad read", c->fd);
+			c->dead = 1;
+			return;
+		}
+		break;
+	}
+
+	if (c->mode == CONTROL_MODE_UNKNOWN && c->in->len > 0) {
+		if ((unsigned char)c->in->data[0] == CONTROL_FRAMED) {
+			PRINT_DEBUG(("control client %d switched to framed "
+			    "mode\n", c->fd));
+			c->mode = CONTROL_MODE_FRAMED;
+			sbuf_consume(c->in, 1);
+		} else
+			c->mode = CONTROL_MODE_ONESHOT;
+	}
+
+	/* Run whatever made it in, even if the client hung up after it. */
+	if (c->mode == CONTROL_MODE_FRAMED)
+		control_client_run_framed(c);
+	else if (c->mode == CONTROL_MODE_ONESHOT || eof)
+		control_client_run_oneshot(c, eof);
+
+	if (eof)
+		c->closing = 1;
+	if (got)
+		control_client_progress(c);
+
+	if (!c->dead)
+		control_client_flush(c);
+}
+
+/* The number of pollfd slots control_clients_pollfds() fills in. */
+int
+control_clients_count(void)
+{
+	return list_size(&control_clients);
+}
+
+void
+control_clients_pollfds(struct pollfd *pfd)
+{
+	struct control_client *c;
+
+	list_for_each_entry(c, &control_clients, node) {
+		pfd->fd = c->fd;
+		pfd->events = (c->closing ? 0 : POLLIN) |
+		    (c->out->len > 0 ? POLLOUT : 0);
+		pfd->revents = 0;
+		pfd++;
+	}
+}
+
+/*
+ * Milliseconds until the first control client times out, suitable for poll(),
+ * or -1 if none of them can.
+ */
+int
+control_clients_timeout(void)
+{
+	struct control_client *c;
+	time_t now, first = 0;
+
+	list_for_each_entry(c, &control_clients, node) {
+		if (c->expires && (!first || c->expires < first))
+			first = c->expires;
+	}
 
-	if (send_unix(cl, result, len) != len)
-		warnx("%s: proceeding after bad write", __func__);
+	if (!first)
+		return -1;
+
+	now = control_now();
+	return first > now ? (first - now) * 1000 : 0;
+}
 
-	PRINT_DEBUG(("receive_command: write finished, closing\n"));
-done:
-	free(cmd);
-	close(cl);
+/*
+ * Handle the results of polling the pollfds from control_clients_pollfds(),
+ * in the same order, and drop clients that timed out.
+ */
+void
+control_clients_handle(struct pollfd *pfd, int npfd)
+{
+	struct control_client *c;
+	struct list_head *tmp, *iter;
+	time_t now;
+	int i = 0;
+
+	list_for_each_entry(c, &control_clients, node) {
+		if (i >= npfd)
+			break;
+		if (pfd[i].fd == c->fd && !c->dead) {
+			if (pfd[i].revents & POLLOUT)
+				control_client_flush(c);
+			if (!c->dead && (pfd[i].revents &
+			    (POLLIN | POLLHUP | POLLERR))) {
+				if (c->closing)
+					c->dead = 1;
+				else
+					control_client_read(c);
+			}
+		}
+		i++;
+	}
+
+	now = control_now();
+	list_for_each_safe_entry(c, iter, tmp, &control_clients, node) {
+		if (!c->dead && c->expires && now >= c->expires) {
+			warnx("control client %d timed out", c->fd);
+			c->dead = 1;
+		}
+		if (c->dead)
+			control_client_free(c);
+	}
+}
+
+/* Accept every pending connection on the control socket. */
+void
+receive_command(void)
+{
+	int cl;
+
+	PRINT_DEBUG(("have connection waiting on command socket\n"));
+
+	for (;;) {
+		cl = accept(rp_glob_screen.control_socket_fd, NULL, NULL);
+		if (cl == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				warn("accept");
+			return;
+		}
+		if (fcntl(cl, F_SETFD, FD_CLOEXEC) == -1 ||
+		    fcntl(cl, F_SETFL, fcntl(cl, F_GETFL) | O_NONBLOCK) == -1) {
+			warn("fcntl");
+			close(cl);
+			continue;
+		}
+
+		if (control_clients_count() >= MAX_CONTROL_CLIENTS) {
+			warnx("too many control clients, dropping connection");
+			close(cl);
+			continue;
+		}
+
+		control_client_new(cl);
+	}
 }
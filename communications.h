@@ -23,6 +23,15 @@
 void init_control_socket_path(void);
 void listen_for_commands(void);
 int send_command(int interactive, char *cmd);
+int send_command_stream(int interactive, int infd);
 void receive_command(void);
 
+struct pollfd;
+int control_clients_count(void);
+void control_clients_pollfds(struct pollfd *pfd);
+int control_clients_timeout(void);
+int control_clients_subscribed(int event);
+void control_clients_event(int event, char *record);
+void control_clients_handle(struct pollfd *pfd, int npfd);
+
 #endif	/* ! _SDORFEHS_COMMUNICATIONS_H */
@@ -19,9 +19,23 @@
 /* Needed on Linux for strcasestr */
 #define _GNU_SOURCE
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 
 #include "sdorfehs.h"
 
+struct completion_rank {
+	struct sbuf *s;
+	/*
+	 * Prefix matches (2) rank above other contiguous matches (1), which
+	 * rank above scattered ones (0), whatever their score.
+	 */
+	int tier;
+	int score;
+	/* Position in completion_list, to keep equal scores in order. */
+	int order;
+};
+
 rp_completions *
 completions_new(completion_fn list_fn, enum completion_styles style)
 {
@@ -35,6 +49,9 @@ completions_new(completion_fn list_fn, enum completion_styles style)
 	c->partial = NULL;
 	c->virgin = 1;
 	c->style = style;
+	c->ranked = NULL;
+	c->nranked = 0;
+	c->ranked_pos = 0;
 
 	return c;
 }
@@ -54,6 +71,7 @@ completions_free(rp_completions *c)
 	/* Free the partial string. */
 	free(c->partial);
 
+	free(c->ranked);
 	free(c);
 }
 
@@ -96,6 +114,41 @@ completions_update(rp_completions *c, char *partial)
 	free(new_list);
 }
 
+/*
+ * Score how well completion matches partial as a FUZZY completion, higher is
+ * better, or return -1 if it doesn't match at all.
+ */
+static int
+completions_fuzzy_score(char *completion, char *partial)
+{
+	int i, gap, last = -1, score = 0;
+
+	for (i = 0; completion[i] != '\0' && *partial != '\0'; i++) {
+		if (toupper((unsigned char)completion[i]) !=
+		    toupper((unsigned char)*partial))
+			continue;
+
+		score++;
+		if (i == 0)
+			score += 8;
+		else if (strchr(" -_./:", completion[i - 1]) != NULL)
+			score += 6;
+
+		if (last != -1) {
+			gap = i - last - 1;
+			if (gap == 0)
+				score += 4;
+			else
+				score -= gap < 3 ? gap : 3;
+		}
+
+		last = i;
+		partial++;
+	}
+
+	return *partial == '\0' ? score : -1;
+}
+
 /*
  * Return true if completion is an alternative for partial string, given the
  * style used.
@@ -112,6 +165,9 @@ completions_match(rp_completions *c, char *completion, char *partial)
 	case SUBSTRING:
 		match = (strcasestr(completion, partial) != NULL);
 		break;
+	case FUZZY:
+		match = (completions_fuzzy_score(completion, partial) >= 0);
+		break;
 	}
 
 	return match;
@@ -167,10 +223,108 @@ completions_next_match(rp_completions *c)
 	return NULL;
 }
 
+static int
+completions_rank_cmp(const void *a, const void *b)
+{
+	const struct completion_rank *ra = a, *rb = b;
+
+	if (ra->tier != rb->tier)
+		return rb->tier - ra->tier;
+	if (ra->score != rb->score)
+		return rb->score - ra->score;
+	return ra->order - rb->order;
+}
+
+/*
+ * Rank the completions matching partial.  If partial only adds characters to
+ * the string ranked last time, its matches are a subset of the previous ones,
+ * so only those are scored again instead of regenerating the whole list.
+ */
+static void
+completions_rank(rp_completions *c, char *partial)
+{
+	struct list_head *new_list;
+	struct sbuf *cur;
+	size_t len = strlen(partial);
+	char *s;
+	int i, n;
+
+	if (c->partial == NULL || strlen(partial) < strlen(c->partial) ||
+	    !str_comp(partial, c->partial, strlen(c->partial))) {
+		new_list = c->complete_fn(partial);
+		completions_assign(c, new_list);
+		free(new_list);
+
+		n = 0;
+		list_for_each_entry(cur, &c->completion_list, node)
+			n++;
+
+		free(c->ranked);
+		c->ranked = xmalloc((n ? n : 1) *
+		    sizeof(struct completion_rank));
+		c->nranked = 0;
+		list_for_each_entry(cur, &c->completion_list, node) {
+			c->ranked[c->nranked].s = cur;
+			c->ranked[c->nranked].order = c->nranked;
+			c->nranked++;
+		}
+	}
+
+	for (i = 0, n = 0; i < c->nranked; i++) {
+		s = sbuf_get(c->ranked[i].s);
+		c->ranked[i].score = completions_fuzzy_score(s, partial);
+		if (c->ranked[i].score < 0)
+			continue;
+
+		if (!strncasecmp(s, partial, len))
+			c->ranked[i].tier = 2;
+		else if (strcasestr(s, partial) != NULL)
+			c->ranked[i].tier = 1;
+		else
+			c->ranked[i].tier = 0;
+		c->ranked[n++] = c->ranked[i];
+	}
+	c->nranked = n;
+
+	qsort(c->ranked, c->nranked, sizeof(struct completion_rank),
+	    completions_rank_cmp);
+
+	c->virgin = 0;
+	free(c->partial);
+	c->partial = xstrdup(partial);
+}
+
+/* Offer the FUZZY matches for partial from best to worst, or the reverse. */
+static char *
+completions_fuzzy_complete(rp_completions *c, char *partial, int direction)
+{
+	if (c->virgin) {
+		completions_rank(c, partial);
+		if (c->nranked == 0)
+			return NULL;
+
+		c->ranked_pos = (direction == COMPLETION_NEXT) ? 0 :
+		    c->nranked - 1;
+		return sbuf_get(c->ranked[c->ranked_pos].s);
+	}
+	if (c->nranked == 0)
+		return NULL;
+
+	if (direction == COMPLETION_NEXT)
+		c->ranked_pos = (c->ranked_pos + 1) % c->nranked;
+	else
+		c->ranked_pos = (c->ranked_pos + c->nranked - 1) % c->nranked;
+
+	return sbuf_get(c->ranked[c->ranked_pos].s);
+}
+
 /* Return a completed string that starts with partial. */
 char *
 completions_complete(rp_completions *c, char *partial, int direction)
 {
+	if (c->style == FUZZY)
+		return completions_fuzzy_complete(c, partial, direction);
+
 	if (c->virgin) {
 		completions_update(c, partial);
 
@@ -99,6 +99,15 @@
  */
 #define IGNORE_BADWINDOW 1
 
+/*
+ * Seconds a control socket client gets to make progress sending its command
+ * or reading our reply before it is disconnected.
+ */
+#define CONTROL_CLIENT_TIMEOUT 5
+
+/* Maximum number of clients connected to the control socket at once. */
+#define MAX_CONTROL_CLIENTS 64
+
 /* This is the name of the first vscreen that is created. */
 #define DEFAULT_VSCREEN_NAME "default"
 
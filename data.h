@@ -71,9 +71,54 @@ struct rp_frame {
 	/* Whether this frame is touching an edge before a screen update */
 	enum rp_edge edges;
 
+	/* The frame's leaf in its vscreen's split tree, if it has one. */
+	struct rp_split *split;
+
 	struct list_head node;
 };
 
+/*
+ * A frame as it was when the layout was saved for undo.  Snapshots are
+ * shared between consecutive saves for frames that didn't change.
+ */
+struct rp_frame_snapshot {
+	int refs;
+
+	int number;
+	int x, y, width, height;
+	int screen_width, screen_height;
+	Window win;
+	int last_access;
+	unsigned int dedicated;
+};
+
+/*
+ * A node of the binary tree of splits that the frames of a vscreen were made
+ * with.  Leaves hold a frame, other nodes divide their area between their two
+ * children.  Keeping the share of each child rather than pixels lets the
+ * layout be scaled without the frames drifting apart.
+ */
+struct rp_split {
+	struct rp_split *parent, *child[2];
+
+	/* For leaves. */
+	rp_frame *frame;
+
+	/*
+	 * VERTICALLY puts child[0] left of child[1], HORIZONTALLY above it;
+	 * ratio is the share of the width or height that child[0] gets.
+	 */
+	int way;
+	double ratio;
+
+	/* The area the node was last laid out in. */
+	int x, y, width, height;
+};
+
+#define WIN_CACHE_WM_STATE	(1 << 0)
+#define WIN_CACHE_WINDOW_TYPE	(1 << 1)
+#define WIN_CACHE_NET_WM_STATE	(1 << 2)
+
 struct rp_window {
 	rp_vscreen *vscreen;
 	Window w;
@@ -132,6 +177,36 @@ struct rp_window {
 	 */
 	int intended_frame_number;
 
+	/*
+	 * Our copies of the WM_STATE, _NET_WM_WINDOW_TYPE and _NET_WM_STATE
+	 * properties, each valid while its WIN_CACHE_* bit is set in cached.
+	 * A PropertyNotify drops the copy unless it is the echo of one of our
+	 * own writes, which are counted until then.
+	 */
+	unsigned int cached;
+	long wm_state;
+	Atom window_type;
+	unsigned long *net_wm_state;
+	unsigned long net_wm_state_len;
+	int wm_state_writes;
+	int net_wm_state_writes;
+
+	/* Next window in the same bucket of the X window ID hash. */
+	rp_window *hash_next;
+
+	/*
+	 * Linked into the list of windows whose name has to be refetched,
+	 * empty otherwise.
+	 */
+	struct list_head dirty_node;
+
+	/*
+	 * Linked into the client list and the stacking order published on the
+	 * root window while the window is mapped, empty otherwise.
+	 */
+	struct list_head client_node;
+	struct list_head stacking_node;
+
 	struct list_head node;
 };
 
@@ -185,6 +260,12 @@ struct rp_vscreen {
 	/* Keep track of which numbers have been given to frames. */
 	struct numset *frames_numset;
 
+	/*
+	 * The splits the frames were made with, built from their geometry
+	 * when it is needed. NULL after the frameset was replaced.
+	 */
+	struct rp_split *split_tree;
+
 	/*
 	 * The number of the currently focused frame. One for each vscreen so
 	 * when you switch vscreens the focus doesn't get frobbed.
@@ -200,12 +281,51 @@ struct rp_vscreen {
 	 */
 	struct numset *numset;
 
+	/*
+	 * The mapped windows indexed by their vscreen number, for quick
+	 * lookups.
+	 */
+	rp_window_elem **windows_by_number;
+	int windows_by_number_size;
+
 	struct list_head node;
 };
 
+#define FONT_WIDTH_HASH_SIZE 64
+#define FONT_WIDTH_MAX 1024
+
+/* A memoized glyph advance for a non-ASCII codepoint. */
+struct rp_glyph_width {
+	FcChar32 ucs4;
+	int width;
+	struct rp_glyph_width *next;
+};
+
 struct rp_font {
 	char *name;
 	XftFont *font;
+
+	/*
+	 * Glyph advances measured so far, so rp_text_width only has to ask
+	 * Xft about each codepoint once.  ASCII lives in a flat table where
+	 * -1 means not yet measured, everything else in a small hash capped
+	 * at FONT_WIDTH_MAX entries.
+	 */
+	short ascii_width[128];
+	struct rp_glyph_width *widths[FONT_WIDTH_HASH_SIZE];
+	int nwidths;
+
+	struct list_head node;
+};
+
+struct rp_draw {
+	Drawable d;
+	XftDraw *draw;
+};
+
+struct rp_color {
+	char *name;
+	XftColor color;
 };
 
 struct rp_screen {
@@ -231,9 +351,21 @@ struct rp_screen {
 	struct sbuf *scratch_buffer;
 
 	XftFont *xft_font;
-	struct rp_font xft_font_cache[5];
+	struct rp_font xft_default_font;
+
+	/* Most recently used first, at most defaults.font_cache_size long */
+	struct list_head xft_font_cache;
+	int xft_font_cache_count;
 	XftColor xft_fgcolor, xft_bgcolor;
 
+	/*
+	 * Xft draw contexts and named colors used by rp_draw_string, kept
+	 * around so repeated redraws of the bar don't have to go back to the
+	 * server each time.
+	 */
+	struct rp_draw xft_draw_cache[8];
+	struct rp_color xft_color_cache[16];
+
 	struct list_head vscreens;
 	struct numset *vscreens_numset;
 	rp_vscreen *current_vscreen;
@@ -246,11 +378,14 @@ struct rp_screen {
 	struct list_head node;
 };
 
+struct compiled_action;
+
 struct rp_action {
 	KeySym key;
 	unsigned int state;
 	char *data;	/* misc data to be passed to the function */
-	/* void (*func)(void *); */
+	/* data resolved ahead of time, or NULL to go through command() */
+	struct compiled_action *compiled;
 };
 
 struct rp_keymap {
@@ -259,6 +394,15 @@ struct rp_keymap {
 	int actions_last;
 	int actions_size;
 
+	/*
+	 * Hash indexes into actions by key and by command, index_size slots
+	 * each with -1 marking empty ones.  Both point at the first matching
+	 * action, like a scan of actions would find.
+	 */
+	int *key_index;
+	int *action_index;
+	int index_size;
+
 	/* This structure can be part of a list. */
 	struct list_head node;
 };
@@ -288,6 +432,7 @@ struct rp_defaults {
 	int bar_border_width;
 	int bar_in_padding;
 	int bar_sticky;
+	int bar_max_fps;
 
 	int frame_indicator_timeout;
 	int frame_resize_unit;
@@ -298,6 +443,7 @@ struct rp_defaults {
 	int padding_bottom;
 
 	char *font_string;
+	int font_cache_size;
 
 	char *fgcolor_string;
 	char *bgcolor_string;
@@ -420,12 +566,19 @@ typedef struct list_head *(*completion_fn) (char *string);
 
   SUBSTRING: The partial string shall be a subpart of the completion. Case
   is ignored.
+
+  FUZZY: The characters of the partial string shall appear in order in the
+  completion. Case is ignored. Matches are offered best first, preferring
+  consecutive characters and characters at the start of words.
 */
 enum completion_styles {
 	BASIC,
-	SUBSTRING
+	SUBSTRING,
+	FUZZY
 };
 
+struct completion_rank;
+
 struct rp_completions {
 	/*
 	 * A pointer to the partial string that is being completed. We need to
@@ -454,6 +607,14 @@ struct rp_completions {
 
 	/* The completion style used to perform string comparisons */
 	enum completion_styles style;
+
+	/*
+	 * For FUZZY, the matches for partial, best first, and which one was
+	 * offered last.
+	 */
+	struct completion_rank *ranked;
+	int nranked;
+	int ranked_pos;
 };
 
 struct rp_input_line {
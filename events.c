@@ -109,7 +109,7 @@ unmap_notify(XEvent *ev)
 		return;
 
 	/* FIXME: Should we only look in the mapped window list? */
-	win = find_window_in_list(ev->xunmap.window, &rp_mapped_window);
+	win = find_mapped_window(ev->xunmap.window);
 
 	if (win == NULL)
 		return;
@@ -253,6 +253,9 @@ destroy_window(XDestroyWindowEvent *ev)
 	 * we can safely stop managing it.
 	 */
 	unmanage(win);
+
+	/* Make sure any BadWindow errors arrive while they are ignored. */
+	XSync(dpy, False);
 	ignore_badwindow--;
 }
 
@@ -325,7 +328,6 @@ configure_request(XConfigureRequestEvent *e)
 			XConfigureWindow(dpy, win->w,
 			    e->value_mask & (CWX|CWY|CWBorderWidth|CWWidth|CWHeight),
 			    &changes);
-			XSync(dpy, False);
 			if (win->state == NormalState)
 				maximize(win);
 		}
@@ -359,7 +361,7 @@ client_msg(XClientMessageEvent *ev)
 	PRINT_DEBUG(("Received client message for window 0x%lx.\n", ev->window));
 
 	if (s == NULL) {
-		win = find_window_in_list(ev->window, &rp_mapped_window);
+		win = find_mapped_window(ev->window);
 		if (!win) {
 			PRINT_DEBUG(("can't find screen or window for "
 			    "XClientMessageEvent\n"));
@@ -458,9 +460,8 @@ handle_key(KeySym ks, unsigned int mod, rp_screen *s)
 		hide_bar(s, 1);
 	hide_frame_indicator();
 
-	/* Disable any alarm that was going to go off. */
-	alarm(0);
-	alarm_signalled = 0;
+	/* Keep the bar from timing out while the key is handled. */
+	bar_cancel_alarm();
 
 	/* Call the top level key pressed hook. */
 	hook_run(&rp_key_hook);
@@ -479,7 +480,7 @@ handle_key(KeySym ks, unsigned int mod, rp_screen *s)
 		if (defaults.bar_sticky)
 			hide_bar(s, 0);
 
-		result = command(1, key_action->data);
+		result = command_action(1, key_action);
 
 		if (result) {
 			if (result->output)
@@ -556,11 +557,7 @@ property_notify(XEvent *ev)
 		}
 	} else if (ev->xproperty.atom == XA_WM_NAME) {
 		PRINT_DEBUG(("updating window name\n"));
-		if (update_window_name(win)) {
-			update_window_names(win->vscreen->screen,
-			    defaults.window_fmt);
-			hook_run(&rp_title_changed_hook);
-		}
+		mark_window_name_dirty(win);
 	} else if (ev->xproperty.atom == XA_WM_NORMAL_HINTS) {
 		PRINT_DEBUG(("updating window normal hints\n"));
 		update_normal_hints(win);
@@ -570,8 +567,13 @@ property_notify(XEvent *ev)
 		PRINT_DEBUG(("Transient for\n"));
 		win->transient = XGetTransientForHint(dpy, win->w,
 		    &win->transient_for);
+	} else if (ev->xproperty.atom == wm_state) {
+		uncache_window_property(win, WIN_CACHE_WM_STATE);
+	} else if (ev->xproperty.atom == _net_wm_window_type) {
+		uncache_window_property(win, WIN_CACHE_WINDOW_TYPE);
 	} else if (ev->xproperty.atom == _net_wm_state) {
-		check_state(win);
+		if (uncache_window_property(win, WIN_CACHE_NET_WM_STATE))
+			check_state(win);
 	} else {
 		PRINT_DEBUG(("Unhandled property notify event: %ld\n",
 		    ev->xproperty.atom));
@@ -600,6 +602,7 @@ colormap_notify(XEvent *ev)
 		if (win == current_window()
 		    && !rp_current_screen->bar_is_raised) {
 			XInstallColormap(dpy, win->colormap);
+			XSync(dpy, False);
 		}
 		ignore_badwindow--;
 	}
@@ -828,25 +831,13 @@ delegate_event(XEvent *ev)
 static void
 handle_signals(void)
 {
-	/* An alarm means we need to hide the popup windows. */
-	if (alarm_signalled > 0) {
-		rp_screen *cur;
-
-		PRINT_DEBUG(("SIGALRM received\n"));
-
-		/* Only hide the bar if it times out. */
-		if (defaults.bar_timeout > 0) {
-			list_for_each_entry(cur, &rp_screens, node) {
-				hide_bar(cur, 0);
-			}
-		}
-		hide_frame_indicator();
-		alarm_signalled = 0;
-	}
 	if (chld_signalled > 0) {
 		rp_child_info *cur;
 		struct list_head *iter, *tmp;
 
+		chld_signalled = 0;
+		check_child_procs();
+
 		/* Report and remove terminated processes. */
 		list_for_each_safe_entry(cur, iter, tmp, &rp_children, node) {
 			if (cur->terminated) {
@@ -860,8 +851,6 @@ handle_signals(void)
 				free(cur);
 			}
 		}
-
-		chld_signalled = 0;
 	}
 	if (hup_signalled > 0) {
 		PRINT_DEBUG(("restarting\n"));
@@ -887,28 +876,63 @@ handle_signals(void)
 void
 listen_for_events(void)
 {
-	struct pollfd pfd[3];
-	int pollfifo = 1;
-
-	memset(&pfd, 0, sizeof(pfd));
-	pfd[0].fd = ConnectionNumber(dpy);
-	pfd[0].events = POLLIN;
-	pfd[1].fd = rp_glob_screen.control_socket_fd;
-	pfd[1].events = POLLIN;
-	pfd[2].fd = rp_glob_screen.bar_fifo_fd;
-	pfd[2].events = POLLIN;
+	struct pollfd *pfd = NULL;
+	int npfd, timeout, ctimeout, pollfifo = 1;
 
 	/* Loop forever. */
 	for (;;) {
+		/*
+		 * Signals and timers are seen to on every pass, so that a
+		 * steady stream of X events can't hold them off.
+		 */
 		handle_signals();
+		timers_run();
 
 		if (!XPending(dpy)) {
+			/*
+			 * The queue is drained, so deal with the windows that
+			 * changed their name while processing it and publish
+			 * the client lists if they changed.
+			 */
+			update_dirty_window_names();
+			update_client_lists();
+			if (XPending(dpy))
+				continue;
+
 			if (pollfifo && rp_glob_screen.bar_fifo_fd == -1)
 				pollfifo = 0;
-			else if (pollfifo)
-				pfd[2].fd = rp_glob_screen.bar_fifo_fd;
 
-			poll(pfd, pollfifo ? 3 : 2, -1);
+			/*
+			 * The X connection, the control socket, the bar FIFO,
+			 * the signal pipe and any control clients that keep
+			 * their connection open.
+			 */
+			npfd = 4 + control_clients_count();
+			pfd = xrealloc(pfd, npfd * sizeof(struct pollfd));
+			memset(pfd, 0, npfd * sizeof(struct pollfd));
+			pfd[0].fd = ConnectionNumber(dpy);
+			pfd[0].events = POLLIN;
+			pfd[1].fd = rp_glob_screen.control_socket_fd;
+			pfd[1].events = POLLIN;
+			pfd[2].fd = pollfifo ? rp_glob_screen.bar_fifo_fd : -1;
+			pfd[2].events = POLLIN;
+			pfd[3].fd = rp_signal_pipe[0];
+			pfd[3].events = POLLIN;
+			control_clients_pollfds(pfd + 4);
+
+			/* Wake up for whichever timeout comes first */
+			timeout = timers_timeout();
+			ctimeout = control_clients_timeout();
+			if (timeout == -1 ||
+			    (ctimeout != -1 && ctimeout < timeout))
+				timeout = ctimeout;
+
+			poll(pfd, npfd, timeout);
+
+			if (pfd[3].revents & POLLIN) {
+				drain_signal_pipe();
+				handle_signals();
+			}
 
 			if (pollfifo && (pfd[2].revents & (POLLERR|POLLNVAL))) {
 				warnx("error polling on FIFO");
@@ -919,6 +943,8 @@ listen_for_events(void)
 			if (pollfifo && (pfd[2].revents & (POLLHUP|POLLIN)))
 				bar_read_fifo();
 
+			control_clients_handle(pfd + 4, npfd - 4);
+
 			if (pfd[1].revents & (POLLHUP|POLLIN))
 				receive_command();
 
@@ -926,8 +952,18 @@ listen_for_events(void)
 				continue;
 		}
 
-		XNextEvent(dpy, &rp_current_event);
-		delegate_event(&rp_current_event);
-		XSync(dpy, False);
+		/*
+		 * Dispatch the whole batch of events that has already been
+		 * read without a round trip to the server in between, and
+		 * only flush our requests once the batch is done. Paths that
+		 * need errors to arrive in order (see ignore_badwindow) sync
+		 * on their own.
+		 */
+		do {
+			XNextEvent(dpy, &rp_current_event);
+			delegate_event(&rp_current_event);
+		} while (XEventsQueued(dpy, QueuedAlready) > 0);
+
+		XFlush(dpy);
 	}
 }
@@ -149,6 +149,7 @@ init_frame(rp_frame *f)
 	f->last_access = 0;
 	f->dedicated = 0;
 	f->restore_win_number = EMPTY;
+	f->split = NULL;
 }
 
 rp_frame *
@@ -186,6 +187,7 @@ frame_copy(rp_frame *frame)
 	copy->height = frame->height;
 	copy->win_number = frame->win_number;
 	copy->last_access = frame->last_access;
+	copy->split = NULL;
 
 	return copy;
 }
@@ -220,6 +222,50 @@ frame_dump(rp_frame *frame, rp_vscreen *vscreen)
 	return tmp;
 }
 
+/*
+ * Adjust a frame read back from a dump to the current screen size, and fix
+ * any problems with it.
+ */
+static void
+frame_adjust(rp_frame *f, rp_vscreen *vscreen, int s_width, int s_height)
+{
+	/*
+	 * Adjust x, y, width and height to a possible screen size change.
+	 * Scale the edges rather than the size, so frames that shared an edge
+	 * still do.
+	 */
+	if (s_width > 0) {
+		f->width = ((f->x + f->width) * vscreen->screen->width) /
+		    s_width;
+		f->x = (f->x * vscreen->screen->width) / s_width;
+		f->width -= f->x;
+	}
+	if (s_height > 0) {
+		f->height = ((f->y + f->height) * vscreen->screen->height) /
+		    s_height;
+		f->y = (f->y * vscreen->screen->height) / s_height;
+		f->height -= f->y;
+	}
+	/*
+	 * Perform some integrity checks on what we got and fix any problems.
+	 */
+	if (f->number <= 0)
+		f->number = 0;
+	if (f->x <= 0)
+		f->x = 0;
+	if (f->y <= 0)
+		f->y = 0;
+	if (f->width <= (defaults.window_border_width * 2) + (defaults.gap * 2))
+		f->width = (defaults.window_border_width * 2) +
+		    (defaults.gap * 2) + 1;
+	if (f->height <= (defaults.window_border_width * 2) +
+	    (defaults.gap * 2))
+		f->height = (defaults.window_border_width * 2) +
+		    (defaults.gap * 2) + 1;
+	if (f->last_access < 0)
+		f->last_access = 0;
+}
+
 /* Used only by frame_read */
 #define read_slot(x) do { tmp = strtok_ws (NULL); x = strtol(tmp,NULL,10); } while(0)
 
@@ -292,36 +338,10 @@ frame_read(char *str, rp_vscreen *vscreen)
 		warnx("frame has trailing garbage: %s", tmp);
 	free(d);
 
-	/* adjust x, y, width and height to a possible screen size change */
-	if (s_width > 0) {
-		f->x = (f->x * vscreen->screen->width) / s_width;
-		f->width = (f->width * vscreen->screen->width) / s_width;
-	}
-	if (s_height > 0) {
-		f->y = (f->y * vscreen->screen->height) / s_height;
-		f->height = (f->height * vscreen->screen->height) / s_height;
-	}
-	/*
-	 * Perform some integrity checks on what we got and fix any problems.
-	 */
-	if (f->number <= 0)
-		f->number = 0;
-	if (f->x <= 0)
-		f->x = 0;
-	if (f->y <= 0)
-		f->y = 0;
-	if (f->width <= (defaults.window_border_width * 2) + (defaults.gap * 2))
-		f->width = (defaults.window_border_width * 2) +
-		    (defaults.gap * 2) + 1;
-	if (f->height <= (defaults.window_border_width * 2) +
-	    (defaults.gap * 2))
-		f->height = (defaults.window_border_width * 2) +
-		    (defaults.gap * 2) + 1;
-	if (f->last_access < 0)
-		f->last_access = 0;
+	frame_adjust(f, vscreen, s_width, s_height);
 
 	/* Find the window with the X11 window ID. */
-	win = find_window_in_list(w, &rp_mapped_window);
+	win = find_mapped_window(w);
 	if (win)
 		f->win_number = win->number;
 	else
@@ -331,3 +351,83 @@ frame_read(char *str, rp_vscreen *vscreen)
 }
 
 #undef read_slot
+
+/*
+ * Save the frame for undo, sharing prev if the frame hasn't changed since it
+ * was taken.
+ */
+struct rp_frame_snapshot *
+frame_snapshot(rp_frame *frame, struct rp_frame_snapshot *prev)
+{
+	struct rp_frame_snapshot *s;
+	rp_window *win;
+	Window w;
+
+	win = find_window_number(frame->win_number);
+	w = win ? win->w : 0;
+
+	if (prev && prev->number == frame->number && prev->x == frame->x &&
+	    prev->y == frame->y && prev->width == frame->width &&
+	    prev->height == frame->height &&
+	    prev->screen_width == frame->vscreen->screen->width &&
+	    prev->screen_height == frame->vscreen->screen->height &&
+	    prev->win == w && prev->last_access == frame->last_access &&
+	    prev->dedicated == frame->dedicated) {
+		prev->refs++;
+		return prev;
+	}
+
+	s = xmalloc(sizeof(struct rp_frame_snapshot));
+	s->refs = 1;
+	s->number = frame->number;
+	s->x = frame->x;
+	s->y = frame->y;
+	s->width = frame->width;
+	s->height = frame->height;
+	s->screen_width = frame->vscreen->screen->width;
+	s->screen_height = frame->vscreen->screen->height;
+	s->win = w;
+	s->last_access = frame->last_access;
+	s->dedicated = frame->dedicated;
+
+	return s;
+}
+
+void
+frame_snapshot_free(struct rp_frame_snapshot *s)
+{
+	if (s && --s->refs == 0)
+		free(s);
+}
+
+/* Create a frame from a snapshot, like frame_read does from a dump. */
+rp_frame *
+frame_restore(struct rp_frame_snapshot *s, rp_vscreen *vscreen)
+{
+	rp_window *win;
+	rp_frame *f;
+
+	f = xmalloc(sizeof(rp_frame));
+	init_frame(f);
+	f->vscreen = vscreen;
+
+	f->number = s->number;
+	f->x = s->x;
+	f->y = s->y;
+	f->width = s->width;
+	f->height = s->height;
+	f->last_access = s->last_access;
+	f->dedicated = s->dedicated;
+
+	if (s->screen_width != vscreen->screen->width ||
+	    s->screen_height != vscreen->screen->height)
+		frame_adjust(f, vscreen, s->screen_width, s->screen_height);
+
+	win = find_mapped_window(s->win);
+	if (win)
+		f->win_number = win->number;
+	else
+		f->win_number = EMPTY;
+
+	return f;
+}
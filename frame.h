@@ -44,6 +44,10 @@ void frame_free(rp_vscreen *v, rp_frame *f);
 rp_frame *frame_copy(rp_frame *frame);
 char *frame_dump(rp_frame *frame, rp_vscreen *vscreen);
 rp_frame *frame_read(char *str, rp_vscreen *vscreen);
+struct rp_frame_snapshot *frame_snapshot(rp_frame *frame,
+    struct rp_frame_snapshot *prev);
+void frame_snapshot_free(struct rp_frame_snapshot *s);
+rp_frame *frame_restore(struct rp_frame_snapshot *s, rp_vscreen *vscreen);
 
 rp_vscreen *frames_vscreen(rp_frame *);
 
@@ -41,10 +41,10 @@
 #define FD_CLOEXEC 1
 #endif
 
-int alarm_signalled = 0;
 int kill_signalled = 0;
 int hup_signalled = 0;
 int chld_signalled = 0;
+int rp_signal_pipe[2] = { -1, -1 };
 
 int rp_font_ascent, rp_font_descent, rp_font_width;
 
@@ -300,62 +300,242 @@ set_window_focus(Window window)
 	    RevertToPointerRoot, CurrentTime);
 }
 
-XftFont *
-rp_get_font(rp_screen *s, char *font)
+void
+rp_init_font(struct rp_font *f, char *name, XftFont *font)
 {
-	XftFont *f;
-	int fslots = sizeof(s->xft_font_cache) / sizeof(struct rp_font);
+	memset(f, 0, sizeof(struct rp_font));
+	memset(f->ascii_width, 0xff, sizeof(f->ascii_width));
+	f->name = name;
+	f->font = font;
+}
+
+void
+rp_clear_font_widths(struct rp_font *f)
+{
+	struct rp_glyph_width *g, *next;
 	int x;
 
-	if (!font || font[0] == '\0')
-		return s->xft_font;
+	for (x = 0; x < FONT_WIDTH_HASH_SIZE; x++) {
+		for (g = f->widths[x]; g; g = next) {
+			next = g->next;
+			free(g);
+		}
+		f->widths[x] = NULL;
+	}
+	f->nwidths = 0;
+	memset(f->ascii_width, 0xff, sizeof(f->ascii_width));
+}
 
-	for (x = 0; x < fslots; x++) {
-		if (!s->xft_font_cache[x].name)
-			break;
+static void
+rp_free_font(struct rp_font *f)
+{
+	list_del(&f->node);
+	rp_clear_font_widths(f);
+	XftFontClose(dpy, f->font);
+	free(f->name);
+	free(f);
+}
+
+static struct rp_font *
+rp_get_font_entry(rp_screen *s, char *font)
+{
+	struct rp_font *cur;
+	XftFont *f;
 
-		if (strcmp(s->xft_font_cache[x].name, font) == 0)
-			return s->xft_font_cache[x].font;
+	if (!font || font[0] == '\0')
+		return &s->xft_default_font;
+
+	list_for_each_entry(cur, &s->xft_font_cache, node) {
+		if (strcmp(cur->name, font) == 0) {
+			/* keep the list in most recently used order */
+			list_move(&cur->node, &s->xft_font_cache);
+			return cur;
+		}
 	}
 
 	/* not in the cache, make sure we can open it first */
 	f = XftFontOpenName(dpy, DefaultScreen(dpy), font);
 	if (!f) {
 		warnx("failed opening xft font \"%s\"", font);
-		return s->xft_font;
+		return &s->xft_default_font;
 	}
 
 	PRINT_DEBUG(("font \"%s\" not in font cache\n", font));
 
+	/* make room for the new one */
+	rp_trim_cached_fonts(s, defaults.font_cache_size - 1);
+
+	cur = xmalloc(sizeof(struct rp_font));
+	rp_init_font(cur, xstrdup(font), f);
+	list_add(&cur->node, &s->xft_font_cache);
+	s->xft_font_cache_count++;
+
+	return cur;
+}
+
+XftFont *
+rp_get_font(rp_screen *s, char *font)
+{
+	return rp_get_font_entry(s, font)->font;
+}
+
+/* Close the least recently used fonts until at most size are left open. */
+void
+rp_trim_cached_fonts(rp_screen *s, int size)
+{
+	struct rp_font *last;
+
+	while (s->xft_font_cache_count > size) {
+		list_last(last, &s->xft_font_cache, node);
+		if (last == NULL)
+			break;
+
+		rp_free_font(last);
+		s->xft_font_cache_count--;
+	}
+}
+
+void
+rp_clear_cached_fonts(rp_screen *s)
+{
+	rp_trim_cached_fonts(s, 0);
+}
+
+static XftDraw *
+rp_get_draw(rp_screen *s, Drawable d)
+{
+	XftDraw *draw;
+	int dslots = sizeof(s->xft_draw_cache) / sizeof(struct rp_draw);
+	int x;
+
+	for (x = 0; x < dslots; x++) {
+		if (!s->xft_draw_cache[x].draw)
+			break;
+
+		if (s->xft_draw_cache[x].d == d)
+			return s->xft_draw_cache[x].draw;
+	}
+
+	draw = XftDrawCreate(dpy, d, DefaultVisual(dpy, s->screen_num),
+	    DefaultColormap(dpy, s->screen_num));
+	if (!draw)
+		return NULL;
+
+	/* free up the last slot if needed */
+	if (x == dslots)
+		XftDrawDestroy(s->xft_draw_cache[x - 1].draw);
+
+	for (x = dslots - 1; x >= 1; x--)
+		memcpy(&s->xft_draw_cache[x], &s->xft_draw_cache[x - 1],
+		    sizeof(struct rp_draw));
+
+	s->xft_draw_cache[0].d = d;
+	s->xft_draw_cache[0].draw = draw;
+
+	return draw;
+}
+
+/*
+ * Drop any cached draw context for a drawable that is about to be destroyed,
+ * so a later drawable reusing its XID doesn't get a stale one.
+ */
+void
+rp_uncache_draw(Drawable d)
+{
+	rp_screen *s;
+	int dslots, x;
+
+	list_for_each_entry(s, &rp_screens, node) {
+		dslots = sizeof(s->xft_draw_cache) / sizeof(struct rp_draw);
+
+		for (x = 0; x < dslots; x++) {
+			if (!s->xft_draw_cache[x].draw)
+				break;
+			if (s->xft_draw_cache[x].d != d)
+				continue;
+
+			XftDrawDestroy(s->xft_draw_cache[x].draw);
+			memmove(&s->xft_draw_cache[x],
+			    &s->xft_draw_cache[x + 1],
+			    (dslots - x - 1) * sizeof(struct rp_draw));
+			memset(&s->xft_draw_cache[dslots - 1], 0,
+			    sizeof(struct rp_draw));
+			break;
+		}
+	}
+}
+
+void
+rp_clear_cached_draws(rp_screen *s)
+{
+	int x;
+
+	for (x = 0; x < (sizeof(s->xft_draw_cache) / sizeof(struct rp_draw));
+	    x++) {
+		if (s->xft_draw_cache[x].draw)
+			XftDrawDestroy(s->xft_draw_cache[x].draw);
+	}
+	memset(s->xft_draw_cache, 0, sizeof(s->xft_draw_cache));
+}
+
+static int
+rp_get_color(rp_screen *s, char *name, XftColor *color)
+{
+	struct rp_color c;
+	int cslots = sizeof(s->xft_color_cache) / sizeof(struct rp_color);
+	int x;
+
+	for (x = 0; x < cslots; x++) {
+		if (!s->xft_color_cache[x].name)
+			break;
+
+		if (strcmp(s->xft_color_cache[x].name, name) == 0) {
+			memcpy(color, &s->xft_color_cache[x].color,
+			    sizeof(XftColor));
+			return 1;
+		}
+	}
+
+	if (!XftColorAllocName(dpy, DefaultVisual(dpy, s->screen_num),
+	    DefaultColormap(dpy, s->screen_num), name, &c.color))
+		return 0;
+
+	PRINT_DEBUG(("color \"%s\" not in color cache\n", name));
+
 	/* free up the last slot if needed */
-	if (x == fslots) {
-		free(s->xft_font_cache[x - 1].name);
-		XftFontClose(dpy, s->xft_font_cache[x - 1].font);
+	if (x == cslots) {
+		free(s->xft_color_cache[x - 1].name);
+		XftColorFree(dpy, DefaultVisual(dpy, s->screen_num),
+		    DefaultColormap(dpy, s->screen_num),
+		    &s->xft_color_cache[x - 1].color);
 	}
 
-	/* shift all the cache entries to free up the first slot */
-	for (x = fslots - 1; x >= 1; x--)
-		memcpy(&s->xft_font_cache[x], &s->xft_font_cache[x - 1],
-		    sizeof(struct rp_font));
+	for (x = cslots - 1; x >= 1; x--)
+		memcpy(&s->xft_color_cache[x], &s->xft_color_cache[x - 1],
+		    sizeof(struct rp_color));
 
-	s->xft_font_cache[0].name = xstrdup(font);
-	s->xft_font_cache[0].font = f;
+	c.name = xstrdup(name);
+	memcpy(&s->xft_color_cache[0], &c, sizeof(struct rp_color));
+	memcpy(color, &c.color, sizeof(XftColor));
 
-	return f;
+	return 1;
 }
 
 void
-rp_clear_cached_fonts(rp_screen *s)
+rp_clear_cached_colors(rp_screen *s)
 {
 	int x;
 
-	for (x = 0; x < (sizeof(s->xft_font_cache) / sizeof(struct rp_font));
+	for (x = 0; x < (sizeof(s->xft_color_cache) / sizeof(struct rp_color));
 	    x++) {
-		if (s->xft_font_cache[x].name) {
-			free(s->xft_font_cache[x - 1].name);
-			XftFontClose(dpy, s->xft_font_cache[x].font);
+		if (s->xft_color_cache[x].name) {
+			free(s->xft_color_cache[x].name);
+			XftColorFree(dpy, DefaultVisual(dpy, s->screen_num),
+			    DefaultColormap(dpy, s->screen_num),
+			    &s->xft_color_cache[x].color);
 		}
 	}
+	memset(s->xft_color_cache, 0, sizeof(s->xft_color_cache));
 }
 
 void
@@ -369,8 +549,7 @@ rp_draw_string(rp_screen *s, Drawable d, int style, int x, int y, char *string,
 	if (length < 0)
 		length = strlen(string);
 
-	draw = XftDrawCreate(dpy, d, DefaultVisual(dpy, s->screen_num),
-	    DefaultColormap(dpy, s->screen_num));
+	draw = rp_get_draw(s, d);
 	if (!draw) {
 		warnx("no Xft font available");
 		return;
@@ -381,34 +560,69 @@ rp_draw_string(rp_screen *s, Drawable d, int style, int x, int y, char *string,
 			memcpy(&xftcolor, &s->xft_fgcolor, sizeof(XftColor));
 		else
 			memcpy(&xftcolor, &s->xft_bgcolor, sizeof(XftColor));
-	} else {
-		/*
-		 * This won't actually allocate anything if the color is
-		 * already allocated.
-		 */
-		if (!XftColorAllocName(dpy, DefaultVisual(dpy, s->screen_num),
-		    DefaultColormap(dpy, s->screen_num), color, &xftcolor)) {
-			warnx("couldn't XftColorAllocName \"%s\"", color);
-			memcpy(&xftcolor, &s->xft_fgcolor, sizeof(XftColor));
-		}
+	} else if (!rp_get_color(s, color, &xftcolor)) {
+		warnx("couldn't XftColorAllocName \"%s\"", color);
+		memcpy(&xftcolor, &s->xft_fgcolor, sizeof(XftColor));
 	}
 
 	XftDrawStringUtf8(draw, &xftcolor, f, x, y, (FcChar8 *)string, length);
-	XftDrawDestroy(draw);
+}
+
+static int
+rp_glyph_width(struct rp_font *f, FcChar32 ucs4)
+{
+	struct rp_glyph_width *g;
+	XGlyphInfo extents;
+	int bucket = ucs4 % FONT_WIDTH_HASH_SIZE;
+
+	if (ucs4 < 128 && f->ascii_width[ucs4] >= 0)
+		return f->ascii_width[ucs4];
+
+	for (g = f->widths[bucket]; g; g = g->next)
+		if (g->ucs4 == ucs4)
+			return g->width;
+
+	XftTextExtents32(dpy, f->font, &ucs4, 1, &extents);
+
+	if (ucs4 < 128) {
+		f->ascii_width[ucs4] = extents.xOff;
+	} else if (f->nwidths < FONT_WIDTH_MAX) {
+		g = xmalloc(sizeof(struct rp_glyph_width));
+		g->ucs4 = ucs4;
+		g->width = extents.xOff;
+		g->next = f->widths[bucket];
+		f->widths[bucket] = g;
+		f->nwidths++;
+	}
+
+	return extents.xOff;
 }
 
 int
 rp_text_width(rp_screen *s, char *string, int count, char *font)
 {
-	XGlyphInfo extents;
-	XftFont *f = rp_get_font(s, font);
+	struct rp_font *f = rp_get_font_entry(s, font);
+	FcChar32 ucs4;
+	int width = 0, len;
 
 	if (count < 0)
 		count = strlen(string);
 
-	XftTextExtentsUtf8(dpy, f, (FcChar8 *)string, count, &extents);
+	/*
+	 * Xft's own extents are just the sum of the glyph advances, so add
+	 * up the memoized ones instead of asking it every time.
+	 */
+	while (count > 0) {
+		len = utf8_decode(string, count, &ucs4);
+		if (len < 0)
+			break;
+
+		width += rp_glyph_width(f, ucs4);
+		string += len;
+		count -= len;
+	}
 
-	return extents.xOff;
+	return width;
 }
 
 /* A case insensitive strncmp. */
@@ -448,21 +662,60 @@ check_child_procs(void)
 				break;
 			}
 		}
+	}
+}
 
-		chld_signalled = 1;
+/*
+ * Signal handlers only set a flag and write a byte to this pipe, which the
+ * main loop polls on so it wakes up to deal with the signal right away.
+ */
+void
+init_signal_pipe(void)
+{
+	int i;
+
+	if (pipe(rp_signal_pipe) == -1)
+		err(1, "pipe");
+
+	for (i = 0; i < 2; i++) {
+		set_close_on_exec(rp_signal_pipe[i]);
+		if (fcntl(rp_signal_pipe[i], F_SETFL,
+		    fcntl(rp_signal_pipe[i], F_GETFL) | O_NONBLOCK) == -1)
+			err(1, "fcntl");
 	}
 }
 
+/* Wake up the main loop; safe to call from a signal handler. */
 void
-chld_handler(int signum)
+signal_wakeup(void)
 {
 	int serrno;
 
+	if (rp_signal_pipe[1] == -1)
+		return;
+
 	serrno = errno;
-	check_child_procs();
+	(void)write(rp_signal_pipe[1], "", 1);
 	errno = serrno;
 }
 
+/* Throw away the wakeups that have been read by the main loop. */
+void
+drain_signal_pipe(void)
+{
+	char buf[64];
+
+	while (read(rp_signal_pipe[0], buf, sizeof(buf)) > 0)
+		;
+}
+
+void
+chld_handler(int signum)
+{
+	chld_signalled = 1;
+	signal_wakeup();
+}
+
 void
 set_sig_handler(int sig, void (*action)(int))
 {
@@ -662,34 +915,3 @@ get_atom(Window w, Atom a, Atom type, unsigned long off, unsigned long *ret,
 
 	return 0;
 }
-
-void
-remove_atom(Window w, Atom a, Atom type, unsigned long remove)
-{
-	unsigned long tmp, read, left, *new;
-	int i, j = 0;
-
-	read = get_atom(w, a, type, 0, &tmp, 1, &left);
-	if (!read)
-		return;
-
-	new = malloc((read + left) * sizeof(*new));
-	if (read && tmp != remove)
-		new[j++] = tmp;
-
-	for (i = 1, read = left = 1; read && left; i += read) {
-		read = get_atom(w, a, type, i, &tmp, 1, &left);
-		if (!read)
-			break;
-		if (tmp != remove)
-			new[j++] = tmp;
-	}
-
-	if (j)
-		XChangeProperty(dpy, w, a, type, 32, PropModeReplace,
-		    (unsigned char *)new, j);
-	else
-		XDeleteProperty(dpy, w, a);
-
-	free(new);
-}
@@ -63,9 +63,10 @@ extern int rp_have_xrandr;
 
 /*
  * Each child process is stored in this list. spawn, creates a new entry in
- * this list, the SIGCHLD handler sets child.terminated to be true and
- * handle_signals in events.c processes each terminated process by printing a
- * message saying the process ended and displaying it's exit code.
+ * this list, after a SIGCHLD handle_signals in events.c reaps the children with
+ * check_child_procs, which sets child.terminated to be true, and processes
+ * each terminated process by printing a message saying the process ended and
+ * displaying it's exit code.
  */
 extern struct list_head rp_children;
 
@@ -150,13 +151,13 @@ extern char **myargv;
 extern struct modifier_info rp_modifier_info;
 
 /*
- * nonzero if an alarm signal was raised. This means we should hide our
- * popup windows.
+ * Set by the signal handlers, which also write to rp_signal_pipe to wake up
+ * the main loop.
  */
-extern int alarm_signalled;
 extern int kill_signalled;
 extern int hup_signalled;
 extern int chld_signalled;
+extern int rp_signal_pipe[2];
 
 /* rudeness levels */
 extern int rp_honour_transient_raise;
@@ -197,14 +198,23 @@ char *get_selection(void);
 
 /* Wrapper font functions to support Xft */
 
+void rp_init_font(struct rp_font *f, char *name, XftFont *font);
+void rp_clear_font_widths(struct rp_font *f);
 XftFont *rp_get_font(rp_screen *s, char *font);
+void rp_trim_cached_fonts(rp_screen *s, int size);
 void rp_clear_cached_fonts(rp_screen *s);
+void rp_uncache_draw(Drawable d);
+void rp_clear_cached_draws(rp_screen *s);
+void rp_clear_cached_colors(rp_screen *s);
 void rp_draw_string(rp_screen *s, Drawable d, int style, int x, int y,
     char *string, int length, char *font, char *color);
 int rp_text_width(rp_screen *s, char *string, int count, char *font);
 
 void check_child_procs(void);
 void chld_handler(int signum);
+void init_signal_pipe(void);
+void signal_wakeup(void);
+void drain_signal_pipe(void);
 void set_sig_handler(int sig, void (*action)(int));
 void set_close_on_exec(int fd);
 void read_rc_file(FILE *file);
@@ -219,6 +229,5 @@ int append_atom(Window w, Atom a, Atom type, unsigned long *val,
     unsigned long nitems);
 unsigned long get_atom(Window w, Atom a, Atom type, unsigned long off,
     unsigned long *ret, unsigned long nitems, unsigned long *left);
-void remove_atom(Window w, Atom a, Atom type, unsigned long remove);
 
 #endif
@@ -22,6 +22,8 @@
 #include <string.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "sdorfehs.h"
 
@@ -64,68 +66,205 @@ extract_shell_part(const char *p)
 struct history_item {
 	struct list_head node;
 	char *line;
+
+	/* Chain of items in the same bucket of the history's hash set. */
+	unsigned int hash;
+	struct history_item *hnext;
 };
 
 static struct history {
 	struct list_head head, *current;
 	size_t count;
+
+	/* Every item hashed by line, for de-duplication. */
+	struct history_item **buckets;
+	size_t nbuckets;
 }       histories[hist_COUNT];
 
+/*
+ * Commands are appended to the history file as they are entered, so a crash
+ * doesn't lose them.  The file is rewritten with just the current history
+ * when it grows to twice the history size and on exit.
+ */
+static char *history_filename = NULL;
+static int history_journal_fd = -1;
+static size_t history_journal_lines = 0;
+
+static unsigned int
+history_hash(const char *line)
+{
+	unsigned int h = 2166136261u;
+
+	while (*line) {
+		h ^= (unsigned char)*line++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static struct history_item *
+history_find(struct history *h, const char *line, unsigned int hash)
+{
+	struct history_item *i;
+
+	if (h->nbuckets == 0)
+		return NULL;
+
+	for (i = h->buckets[hash % h->nbuckets]; i; i = i->hnext)
+		if (i->hash == hash && !strcmp(i->line, line))
+			return i;
+
+	return NULL;
+}
+
+static void
+history_hash_insert(struct history *h, struct history_item *i)
+{
+	struct history_item *cur;
+	size_t slot;
+
+	/*
+	 * Keep the chains short by growing along with the history.  The item
+	 * must not be on h->head yet, or the rebuild would chain it twice.
+	 */
+	if (h->count + 1 > h->nbuckets) {
+		free(h->buckets);
+		h->nbuckets = h->nbuckets ? h->nbuckets * 2 : 64;
+		h->buckets = xmalloc(h->nbuckets * sizeof(*h->buckets));
+		memset(h->buckets, 0, h->nbuckets * sizeof(*h->buckets));
+
+		list_for_each_entry(cur, &h->head, node) {
+			slot = cur->hash % h->nbuckets;
+			cur->hnext = h->buckets[slot];
+			h->buckets[slot] = cur;
+		}
+	}
+
+	slot = i->hash % h->nbuckets;
+	i->hnext = h->buckets[slot];
+	h->buckets[slot] = i;
+}
+
 static void
+history_remove(struct history *h, struct history_item *i)
+{
+	struct history_item **p;
+
+	for (p = &h->buckets[i->hash % h->nbuckets]; *p; p = &(*p)->hnext) {
+		if (*p == i) {
+			*p = i->hnext;
+			break;
+		}
+	}
+
+	if (h->current == &i->node)
+		h->current = &h->head;
+
+	list_del(&i->node);
+	free(i->line);
+	free(i);
+	h->count--;
+}
+
+/* Return 1 if item was added to the history. */
+static int
 history_add_upto(int history_id, const char *item, size_t max)
 {
 	struct history *h = histories + history_id;
 	struct history_item *i;
+	unsigned int hash;
 
 	if (item == NULL || *item == '\0' || isspace((unsigned char) *item))
-		return;
+		return 0;
 
 	list_last(i, &histories[history_id].head, node);
 	if (i && !strcmp(i->line, item))
-		return;
+		return 0;
 
 	if (history_id == hist_COMMAND) {
 		const char *p = extract_shell_part(item);
 		if (p)
 			history_add_upto(hist_SHELLCMD, p, max);
 	}
+
+	hash = history_hash(item);
+	if (defaults.history_compaction &&
+	    (i = history_find(h, item, hash)) != NULL)
+		history_remove(h, i);
+
 	while (h->count >= max) {
 		list_first(i, &h->head, node);
 		if (!i) {
 			h->count = 0;
 			break;
 		}
-		list_del(&i->node);
-		free(i->line);
-		free(i);
-		h->count--;
+		history_remove(h, i);
 	}
 
 	if (max == 0)
-		return;
+		return 0;
 
 	i = xmalloc(sizeof(*i));
 	i->line = xstrdup(item);
+	i->hash = hash;
 
+	history_hash_insert(h, i);
 	list_add_tail(&i->node, &h->head);
 	h->count++;
+
+	return 1;
+}
+
+static void
+history_journal(const char *item)
+{
+	char *line;
+	size_t len;
+
+	if (!defaults.history_size || history_filename == NULL)
+		return;
+
+	if (history_journal_lines >= 2 * (size_t)defaults.history_size) {
+		history_save();
+		return;
+	}
+
+	if (history_journal_fd == -1) {
+		history_journal_fd = open(history_filename,
+		    O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+		if (history_journal_fd == -1) {
+			PRINT_DEBUG(("could not open history %s: %s\n",
+			    history_filename, strerror(errno)));
+			return;
+		}
+	}
+
+	line = xsprintf("%s\n", item);
+	len = strlen(line);
+	if (write(history_journal_fd, line, len) != (ssize_t)len)
+		PRINT_DEBUG(("error writing history to %s: %s\n",
+		    history_filename, strerror(errno)));
+	else
+		history_journal_lines++;
+	free(line);
 }
 
 void
 history_add(int history_id, const char *item)
 {
-	history_add_upto(history_id, item, defaults.history_size);
+	if (history_add_upto(history_id, item, defaults.history_size) &&
+	    history_id == hist_COMMAND)
+		history_journal(item);
 }
 
 void
 history_load(void)
 {
-	char *filename;
-	FILE *f;
-	char *line = NULL;
-	size_t s = 0;
-	ssize_t linelen;
-	int id;
+	struct stat st;
+	char *map, *p, *end, *nl, *line = NULL;
+	size_t linelen, size = 0;
+	int fd, id;
 
 	for (id = hist_NONE; id < hist_COUNT; id++) {
 		INIT_LIST_HEAD(&histories[id].head);
@@ -133,81 +272,120 @@ history_load(void)
 		histories[id].count = 0;
 	}
 
-	filename = get_history_filename();
-	if (!filename)
+	free(history_filename);
+	history_filename = get_history_filename();
+	if (!history_filename)
 		return;
 
-	f = fopen(filename, "r");
-	if (!f) {
-		PRINT_DEBUG(("could not load history from %s: %s", filename,
-		    strerror(errno)));
-		free(filename);
+	fd = open(history_filename, O_RDONLY|O_CLOEXEC);
+	if (fd == -1) {
+		PRINT_DEBUG(("could not load history from %s: %s",
+		    history_filename, strerror(errno)));
 		return;
 	}
-	while ((linelen = getline(&line, &s, f)) >= 0) {
-		while (linelen > 0 && (line[linelen - 1] == '\n' ||
-		    line[linelen - 1] == '\r')) {
-			line[--linelen] = '\0';
-		}
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		PRINT_DEBUG(("error reading history %s: %s\n",
+		    history_filename, strerror(errno)));
+		return;
+	}
+
+	end = map + st.st_size;
+	for (p = map; p < end; p = nl + 1) {
+		if ((nl = memchr(p, '\n', end - p)) == NULL)
+			nl = end;
+
+		linelen = nl - p;
+		while (linelen > 0 && p[linelen - 1] == '\r')
+			linelen--;
 		if (linelen == 0)
 			continue;
+
+		if (linelen + 1 > size) {
+			size = linelen + 1;
+			line = xrealloc(line, size);
+		}
+		memcpy(line, p, linelen);
+		line[linelen] = '\0';
+
 		/* defaults.history_size might be only set later */
 		history_add_upto(hist_COMMAND, line, INT_MAX);
+		history_journal_lines++;
 	}
+
 	free(line);
-	if (ferror(f)) {
-		PRINT_DEBUG(("error reading history %s: %s\n", filename,
-		    strerror(errno)));
-		fclose(f);
-		free(filename);
-		return;
-	}
-	if (fclose(f))
-		PRINT_DEBUG(("error reading %s: %s\n", filename,
-		    strerror(errno)));
-	free(filename);
+	munmap(map, st.st_size);
 }
 
+/* Replace the history file with the current history, restarting the journal. */
 void
 history_save(void)
 {
-	char *filename;
+	char *tmpname;
 	FILE *f;
 	struct history_item *item;
+	size_t skip;
 
-	if (!defaults.history_size)
+	if (!defaults.history_size || history_filename == NULL)
 		return;
 
-	filename = get_history_filename();
-	if (!filename)
-		return;
+	if (history_journal_fd != -1) {
+		close(history_journal_fd);
+		history_journal_fd = -1;
+	}
 
-	f = fopen(filename, "w");
+	/* Write a new file and move it into place, so there always is one. */
+	tmpname = xsprintf("%s.tmp", history_filename);
+	f = fopen(tmpname, "w");
 	if (!f) {
-		PRINT_DEBUG(("could not write history to %s: %s\n", filename,
+		PRINT_DEBUG(("could not write history to %s: %s\n", tmpname,
 		    strerror(errno)));
-		free(filename);
+		free(tmpname);
 		return;
 	}
 	if (fchmod(fileno(f), 0600) == -1)
-		warn("could not change mode to 0600 on %s", filename);
+		warn("could not change mode to 0600 on %s", tmpname);
 
+	skip = 0;
+	if (histories[hist_COMMAND].count > (size_t)defaults.history_size)
+		skip = histories[hist_COMMAND].count - defaults.history_size;
+
+	history_journal_lines = 0;
 	list_for_each_entry(item, &histories[hist_COMMAND].head, node) {
+		if (skip > 0) {
+			skip--;
+			continue;
+		}
 		fputs(item->line, f);
 		putc('\n', f);
+		history_journal_lines++;
 	}
 
 	if (ferror(f)) {
-		PRINT_DEBUG(("error writing history to %s: %s\n", filename,
+		PRINT_DEBUG(("error writing history to %s: %s\n", tmpname,
 		    strerror(errno)));
 		fclose(f);
-		free(filename);
+		unlink(tmpname);
+		free(tmpname);
 		return;
 	}
-	if (fclose(f))
-		PRINT_DEBUG(("error writing history to %s: %s\n", filename,
+	if (fclose(f)) {
+		PRINT_DEBUG(("error writing history to %s: %s\n", tmpname,
 		    strerror(errno)));
-	free(filename);
+		unlink(tmpname);
+		free(tmpname);
+		return;
+	}
+	if (rename(tmpname, history_filename) == -1)
+		PRINT_DEBUG(("could not rename %s to %s: %s\n", tmpname,
+		    history_filename, strerror(errno)));
+	free(tmpname);
 }
 
 void
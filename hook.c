@@ -56,11 +56,78 @@ hook_remove(struct list_head *hook, struct sbuf *s)
 	}
 }
 
+/*
+ * Describe a hook event for control clients subscribed to it: the name of the
+ * event followed by what it is about, the window's number, X window ID and
+ * name for window events.
+ */
+static char *
+hook_event_record(char *name, struct list_head *hook, rp_window *win)
+{
+	rp_window_elem *we;
+	rp_frame *frame;
+
+	if (win == NULL && hook == &rp_switch_win_hook)
+		win = current_window();
+
+	if (win != NULL) {
+		we = vscreen_find_window(&win->vscreen->mapped_windows, win);
+		if (we == NULL)
+			return xsprintf("%s - 0x%lx %s", name, win->w,
+			    window_name(win));
+
+		return xsprintf("%s %d 0x%lx %s", name, we->number, win->w,
+		    window_name(win));
+	}
+
+	if (hook == &rp_switch_win_hook)
+		return xsprintf("%s -", name);
+
+	if (hook == &rp_switch_frame_hook) {
+		frame = current_frame(rp_current_vscreen);
+		return xsprintf("%s %d", name, frame ? frame->number : -1);
+	}
+
+	if (hook == &rp_switch_vscreen_hook)
+		return xsprintf("%s %d %s", name, rp_current_vscreen->number,
+		    rp_current_vscreen->name);
+
+	if (hook == &rp_switch_screen_hook)
+		return xsprintf("%s %d", name, rp_current_screen->number);
+
+	return xstrdup(name);
+}
+
 void
 hook_run(struct list_head *hook)
 {
+	hook_run_window(hook, NULL);
+}
+
+/*
+ * Run the commands of a hook and tell subscribed control clients about it.
+ * win is the window the hook is about, when that isn't the current one.
+ */
+void
+hook_run_window(struct list_head *hook, rp_window *win)
+{
+	struct rp_hook_db_entry *entry;
 	struct sbuf *cur;
 	cmdret *result;
+	char *record;
+	int i;
+
+	for (i = 0, entry = rp_hook_db; entry->name; i++, entry++) {
+		if (entry->hook != hook)
+			continue;
+
+		if (control_clients_subscribed(i)) {
+			record = hook_event_record(entry->name, hook, win);
+			control_clients_event(i, record);
+			free(record);
+		}
+		break;
+	}
 
 	list_for_each_entry(cur, hook, node) {
 		result = command(1, sbuf_get(cur));
@@ -72,16 +139,16 @@ hook_run(struct list_head *hook)
 	}
 }
 
-struct list_head *
-hook_lookup(char *s)
+/* Returns the index of the hook in rp_hook_db, or -1. */
+int
+hook_index(char *s)
 {
-	struct rp_hook_db_entry *entry;
+	int i;
 
-	for (entry = rp_hook_db; entry->name; entry++) {
-		if (!strcmp(s, entry->name)) {
-			return entry->hook;
-		}
+	for (i = 0; rp_hook_db[i].name; i++) {
+		if (!strcmp(s, rp_hook_db[i].name))
+			return i;
 	}
 
-	return NULL;
+	return -1;
 }
@@ -20,8 +20,9 @@
 #define HOOKS_H
 
 void hook_run(struct list_head *hook);
+void hook_run_window(struct list_head *hook, rp_window *win);
 void hook_remove(struct list_head *hook, struct sbuf *s);
 void hook_add(struct list_head *hook, struct sbuf *s);
-struct list_head *hook_lookup(char *s);
+int hook_index(char *s);
 
 #endif
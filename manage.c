@@ -29,12 +29,40 @@
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <X11/keysymdef.h>
+#include <X11/Xlib-xcb.h>
 
 #include "sdorfehs.h"
 
 static char **unmanaged_window_list = NULL;
 static int num_unmanaged_windows = 0;
 
+/*
+ * The number of 32-bit items in WM_NORMAL_HINTS, and in the shorter form that
+ * predates ICCCM 1.0.
+ */
+#define NORMAL_HINTS_LEN	18
+#define NORMAL_HINTS_OLD_LEN	15
+
+/*
+ * The requests update_window_information sends about a window, all before
+ * waiting for the first reply.
+ */
+struct window_info {
+	xcb_get_property_cookie_t net_wm_name;
+	xcb_get_property_cookie_t wm_name;
+	xcb_get_property_cookie_t wm_class;
+	xcb_get_property_cookie_t normal_hints;
+	xcb_get_property_cookie_t transient_for;
+	xcb_get_property_cookie_t window_type;
+	xcb_get_window_attributes_cookie_t attr;
+	xcb_get_geometry_cookie_t geom;
+};
+
+static long window_wm_state(Window w);
+static xcb_get_property_cookie_t request_wm_state(Window w);
+static int unmanaged_name(const char *wname);
+static void map_window_info(rp_window *win, struct window_info *info);
+
 void
 clear_unmanaged_list(void)
 {
@@ -138,80 +166,92 @@ grab_keys_all_wins(void)
 	}
 }
 
-void
-update_normal_hints(rp_window *win)
+/*
+ * Property requests go through XCB, so that all the ones needed about a
+ * window, or about every window at startup, can be sent before waiting for
+ * the first reply instead of each costing a round trip of its own.
+ */
+static xcb_get_property_cookie_t
+request_property(Window w, Atom property, Atom type, uint32_t length)
 {
-	long supplied;
+	return xcb_get_property(XGetXCBConnection(dpy), 0, w, property, type,
+	    0, length);
+}
 
-	XGetWMNormalHints(dpy, win->w, win->hints, &supplied);
+/* Wait for a property, NULL if the window or the property doesn't exist. */
+static xcb_get_property_reply_t *
+property_reply(xcb_get_property_cookie_t cookie)
+{
+	xcb_generic_error_t *error = NULL;
+	xcb_get_property_reply_t *reply;
 
-	/* Discard bogus hints */
-	if ((win->hints->flags & PAspect) && (win->hints->min_aspect.x < 1 ||
-	    win->hints->min_aspect.y < 1 || win->hints->max_aspect.x < 1 ||
-	    win->hints->max_aspect.y < 1))
-		win->hints->flags &= ~PAspect;
-	if ((win->hints->flags & PMaxSize) && win->hints->max_width < 1)
-		win->hints->flags &= ~PMaxSize;
-	if ((win->hints->flags & PMinSize) && win->hints->min_width < 1)
-		win->hints->flags &= ~PMinSize;
-	if ((win->hints->flags & PResizeInc) && (win->hints->width_inc < 1 ||
-	    win->hints->height_inc < 1))
-		win->hints->flags &= ~PResizeInc;
+	reply = xcb_get_property_reply(XGetXCBConnection(dpy), cookie, &error);
+	free(error);
 
-	/* Print debugging output for window hints. */
-#ifdef DEBUG
-	if (win->hints->flags & PMinSize)
-		PRINT_DEBUG(("minx: %d miny: %d\n", win->hints->min_width,
-		    win->hints->min_height));
+	if (reply != NULL && reply->type == XCB_NONE) {
+		free(reply);
+		return NULL;
+	}
+	return reply;
+}
 
-	if (win->hints->flags & PMaxSize)
-		PRINT_DEBUG(("maxx: %d maxy: %d\n", win->hints->max_width,
-		    win->hints->max_height));
+/* Free a property reply and return its first 32-bit item, or def. */
+static unsigned long
+property_long(xcb_get_property_reply_t *reply, unsigned long def)
+{
+	unsigned long val = def;
 
-	if (win->hints->flags & PResizeInc)
-		PRINT_DEBUG(("incx: %d incy: %d\n", win->hints->width_inc,
-		    win->hints->height_inc));
-#endif
-}
+	if (reply != NULL && reply->format == 32 &&
+	    xcb_get_property_value_length(reply) >= 4)
+		val = *(uint32_t *)xcb_get_property_value(reply);
 
+	free(reply);
+	return val;
+}
 
+/*
+ * Work out a window's name from its _NET_WM_NAME and WM_NAME properties,
+ * either of which may be NULL, and free them.
+ */
 static char *
-get_wmname(Window w)
+wmname_from_replies(xcb_get_property_reply_t *net_wm_name,
+    xcb_get_property_reply_t *wm_name)
 {
 	char *name = NULL;
 	XTextProperty text_prop;
-	Atom type = None;
-	int ret = None, n;
-	unsigned long nitems, bytes_after;
-	int format;
+	int ret, n, len;
 	char **cl;
-	unsigned char *val = NULL;
 
 	/*
 	 * Try to use the window's _NET_WM_NAME ewmh property
 	 */
-	ret = XGetWindowProperty(dpy, w, _net_wm_name, 0, 40, False,
-	    xa_utf8_string, &type, &format, &nitems,
-	    &bytes_after, &val);
-	/* We have a valid UTF-8 string */
-	if (ret == Success && type == xa_utf8_string && format == 8 &&
-	    nitems > 0) {
-		name = xstrdup((char *) val);
-		XFree(val);
+	if (net_wm_name != NULL && net_wm_name->type == xa_utf8_string &&
+	    net_wm_name->format == 8 &&
+	    (len = xcb_get_property_value_length(net_wm_name)) > 0) {
+		/* We have a valid UTF-8 string */
+		name = xmalloc(len + 1);
+		memcpy(name, xcb_get_property_value(net_wm_name), len);
+		name[len] = '\0';
 		PRINT_DEBUG(("Fetching window name using "
 		    "_NET_WM_NAME succeeded\n"));
 		PRINT_DEBUG(("WM_NAME: %s\n", name));
-		return name;
+		goto done;
 	}
-	/* Something went wrong for whatever reason */
-	if (ret == Success && val)
-		XFree(val);
 	PRINT_DEBUG(("Could not fetch window name using _NET_WM_NAME\n"));
 
-	if (XGetWMName(dpy, w, &text_prop) == 0) {
-		PRINT_DEBUG(("XGetWMName failed\n"));
-		return NULL;
+	if (wm_name == NULL) {
+		PRINT_DEBUG(("Window has no WM_NAME\n"));
+		goto done;
 	}
+
+	len = xcb_get_property_value_length(wm_name);
+	text_prop.value = xmalloc(len + 1);
+	memcpy(text_prop.value, xcb_get_property_value(wm_name), len);
+	text_prop.value[len] = '\0';
+	text_prop.encoding = wm_name->type;
+	text_prop.format = wm_name->format;
+	text_prop.nitems = wm_name->value_len;
+
 	PRINT_DEBUG(("WM_NAME encoding: "));
 	if (text_prop.encoding == xa_string)
 		PRINT_DEBUG(("STRING\n"));
@@ -245,73 +285,226 @@ get_wmname(Window w)
 	if (ret == Success && cl && n > 0) {
 		name = xstrdup(cl[0]);
 		XFreeStringList(cl);
-	} else if (text_prop.value) {
+	} else {
 		/* Convertion failed, try to get the raw string */
 		name = xstrdup((char *) text_prop.value);
-		XFree(text_prop.value);
 	}
+	free(text_prop.value);
+
 	if (name == NULL) {
 		PRINT_DEBUG(("I can't get the WMName.\n"));
 	} else {
 		PRINT_DEBUG(("WM_NAME: '%s'\n", name));
 	}
 
+done:
+	free(net_wm_name);
+	free(wm_name);
 	return name;
 }
 
-static XClassHint *
-get_class_hints(Window w)
+static xcb_get_property_cookie_t
+request_net_wm_name(Window w)
 {
-	XClassHint *class;
+	return request_property(w, _net_wm_name, xa_utf8_string, 40);
+}
 
-	class = XAllocClassHint();
+static xcb_get_property_cookie_t
+request_wm_name(Window w)
+{
+	return request_property(w, XA_WM_NAME, AnyPropertyType, 1000000);
+}
+
+static char *
+get_wmname(Window w)
+{
+	xcb_get_property_cookie_t net_wm_name, wm_name;
 
-	if (class == NULL)
-		errx(1, "not enough memory for WM_CLASS structure");
+	net_wm_name = request_net_wm_name(w);
+	wm_name = request_wm_name(w);
 
-	XGetClassHint(dpy, w, class);
+	return wmname_from_replies(property_reply(net_wm_name),
+	    property_reply(wm_name));
+}
 
-	return class;
+static xcb_get_property_cookie_t
+request_wm_class(Window w)
+{
+	return request_property(w, XA_WM_CLASS, XA_STRING, 1000000);
 }
 
 /*
- * Reget the WM_NAME property for the window and update its name. Return 1 if
- * the name changed.
+ * Split a WM_CLASS property, which may be NULL, into its instance and class
+ * names, and free it.  The names are left NULL if the property is unset.
  */
-int
-update_window_name(rp_window *win)
+static void
+class_from_reply(xcb_get_property_reply_t *reply, XClassHint *class)
+{
+	char *buf;
+	int len, n;
+
+	class->res_name = NULL;
+	class->res_class = NULL;
+
+	if (reply != NULL && reply->type == XA_STRING && reply->format == 8) {
+		len = xcb_get_property_value_length(reply);
+		buf = xmalloc(len + 1);
+		memcpy(buf, xcb_get_property_value(reply), len);
+		buf[len] = '\0';
+
+		n = strlen(buf);
+		class->res_name = buf;
+		class->res_class = xstrdup(n < len ? buf + n + 1 : "");
+	}
+
+	free(reply);
+}
+
+/*
+ * Update the name and class of the window from the replies to the requests
+ * for them.  Return 1 if either changed.
+ */
+static int
+window_name_from_replies(rp_window *win,
+    xcb_get_property_cookie_t net_wm_name, xcb_get_property_cookie_t wm_name,
+    xcb_get_property_cookie_t wm_class)
 {
 	char *newstr;
 	int changed = 0;
-	XClassHint *class;
+	XClassHint class;
 
-	newstr = get_wmname(win->w);
+	newstr = wmname_from_replies(property_reply(net_wm_name),
+	    property_reply(wm_name));
 	if (newstr != NULL) {
 		changed = changed || win->wm_name == NULL ||
 		    strcmp(newstr, win->wm_name);
 		free(win->wm_name);
 		win->wm_name = newstr;
 	}
-	class = get_class_hints(win->w);
+	class_from_reply(property_reply(wm_class), &class);
 
-	if (class->res_class != NULL
-	    && (win->res_class == NULL || strcmp(class->res_class, win->res_class))) {
+	if (class.res_class != NULL
+	    && (win->res_class == NULL || strcmp(class.res_class, win->res_class))) {
 		changed = 1;
 		free(win->res_class);
-		win->res_class = xstrdup(class->res_class);
+		win->res_class = xstrdup(class.res_class);
 	}
-	if (class->res_name != NULL
-	    && (win->res_name == NULL || strcmp(class->res_name, win->res_name))) {
+	if (class.res_name != NULL
+	    && (win->res_name == NULL || strcmp(class.res_name, win->res_name))) {
 		changed = 1;
 		free(win->res_name);
-		win->res_name = xstrdup(class->res_name);
+		win->res_name = xstrdup(class.res_name);
 	}
-	XFree(class->res_name);
-	XFree(class->res_class);
-	XFree(class);
+	free(class.res_name);
+	free(class.res_class);
 	return changed;
 }
 
+/*
+ * Reget the WM_NAME property for the window and update its name. Return 1 if
+ * the name changed.
+ */
+int
+update_window_name(rp_window *win)
+{
+	xcb_get_property_cookie_t net_wm_name, wm_name, wm_class;
+
+	net_wm_name = request_net_wm_name(win->w);
+	wm_name = request_wm_name(win->w);
+	wm_class = request_wm_class(win->w);
+
+	return window_name_from_replies(win, net_wm_name, wm_name, wm_class);
+}
+
+static xcb_get_property_cookie_t
+request_normal_hints(Window w)
+{
+	return request_property(w, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS,
+	    NORMAL_HINTS_LEN);
+}
+
+/*
+ * Decode a WM_NORMAL_HINTS property, which may be NULL, the way
+ * XGetWMNormalHints does, and free it.  The hints are left alone if the
+ * property is unset or malformed.
+ */
+static void
+normal_hints_from_reply(xcb_get_property_reply_t *reply, XSizeHints *hints)
+{
+	int32_t *p;
+
+	if (reply == NULL || reply->type != XA_WM_SIZE_HINTS ||
+	    reply->format != 32 || reply->value_len < NORMAL_HINTS_OLD_LEN) {
+		free(reply);
+		return;
+	}
+
+	p = xcb_get_property_value(reply);
+	hints->flags = p[0] & (USPosition | USSize | PAllHints);
+	hints->x = p[1];
+	hints->y = p[2];
+	hints->width = p[3];
+	hints->height = p[4];
+	hints->min_width = p[5];
+	hints->min_height = p[6];
+	hints->max_width = p[7];
+	hints->max_height = p[8];
+	hints->width_inc = p[9];
+	hints->height_inc = p[10];
+	hints->min_aspect.x = p[11];
+	hints->min_aspect.y = p[12];
+	hints->max_aspect.x = p[13];
+	hints->max_aspect.y = p[14];
+	if (reply->value_len >= NORMAL_HINTS_LEN) {
+		hints->flags |= p[0] & (PBaseSize | PWinGravity);
+		hints->base_width = p[15];
+		hints->base_height = p[16];
+		hints->win_gravity = p[17];
+	}
+
+	free(reply);
+}
+
+/* Discard bogus WM_NORMAL_HINTS. */
+static void
+sanitize_normal_hints(rp_window *win)
+{
+	if ((win->hints->flags & PAspect) && (win->hints->min_aspect.x < 1 ||
+	    win->hints->min_aspect.y < 1 || win->hints->max_aspect.x < 1 ||
+	    win->hints->max_aspect.y < 1))
+		win->hints->flags &= ~PAspect;
+	if ((win->hints->flags & PMaxSize) && win->hints->max_width < 1)
+		win->hints->flags &= ~PMaxSize;
+	if ((win->hints->flags & PMinSize) && win->hints->min_width < 1)
+		win->hints->flags &= ~PMinSize;
+	if ((win->hints->flags & PResizeInc) && (win->hints->width_inc < 1 ||
+	    win->hints->height_inc < 1))
+		win->hints->flags &= ~PResizeInc;
+
+	/* Print debugging output for window hints. */
+#ifdef DEBUG
+	if (win->hints->flags & PMinSize)
+		PRINT_DEBUG(("minx: %d miny: %d\n", win->hints->min_width,
+		    win->hints->min_height));
+
+	if (win->hints->flags & PMaxSize)
+		PRINT_DEBUG(("maxx: %d maxy: %d\n", win->hints->max_width,
+		    win->hints->max_height));
+
+	if (win->hints->flags & PResizeInc)
+		PRINT_DEBUG(("incx: %d incy: %d\n", win->hints->width_inc,
+		    win->hints->height_inc));
+#endif
+}
+
+void
+update_normal_hints(rp_window *win)
+{
+	normal_hints_from_reply(property_reply(request_normal_hints(win->w)),
+	    win->hints);
+	sanitize_normal_hints(win);
+}
+
 /*
  * This function is used to determine if the window should be treated as a
  * transient.
@@ -331,69 +524,118 @@ window_is_transient(rp_window *win)
 	;
 }
 
+static xcb_get_property_cookie_t
+request_window_type(Window w)
+{
+	return request_property(w, _net_wm_window_type, XA_ATOM, 1);
+}
+
+static Atom
+window_type(Window w)
+{
+	return property_long(property_reply(request_window_type(w)), None);
+}
+
 Atom
 get_net_wm_window_type(rp_window *win)
 {
-	Atom type, window_type = None;
-	int format;
-	unsigned long nitems;
-	unsigned long bytes_left;
-	unsigned char *data;
-
 	if (win == NULL)
 		return None;
 
-	if (XGetWindowProperty(dpy, win->w, _net_wm_window_type, 0, 1L,
-	    False, XA_ATOM, &type, &format, &nitems, &bytes_left,
-	    &data) == Success && nitems > 0) {
-		window_type = *(Atom *)data;
-		XFree(data);
+	if (!(win->cached & WIN_CACHE_WINDOW_TYPE)) {
+		win->window_type = window_type(win->w);
+		win->cached |= WIN_CACHE_WINDOW_TYPE;
 	}
-	return window_type;
+	return win->window_type;
+}
+
+static int
+unmanaged_type(Atom win_type)
+{
+	return (win_type == _net_wm_window_type_dock ||
+	    win_type == _net_wm_window_type_splash ||
+	    win_type == _net_wm_window_type_tooltip ||
+	    win_type == _net_wm_window_type_utility);
 }
 
 int
-is_unmanaged_window_type(Window win)
+is_unmanaged_window_type(Window w)
 {
 	Atom win_type;
-	rp_window tmp;
+	rp_window *win;
 
-	tmp.w = win;
-	win_type = get_net_wm_window_type(&tmp);
-	if (win_type == _net_wm_window_type_dock ||
-	    win_type == _net_wm_window_type_splash ||
-	    win_type == _net_wm_window_type_tooltip ||
-	    win_type == _net_wm_window_type_utility)
-		return 1;
+	if ((win = find_window(w)))
+		win_type = get_net_wm_window_type(win);
+	else
+		win_type = window_type(w);
 
-	return 0;
+	return unmanaged_type(win_type);
 }
 
-void
-update_window_information(rp_window *win)
+/* Send every request update_window_information needs about w. */
+static void
+window_info_request(Window w, struct window_info *info)
 {
-	XWindowAttributes attr;
+	xcb_connection_t *conn = XGetXCBConnection(dpy);
+
+	info->net_wm_name = request_net_wm_name(w);
+	info->wm_name = request_wm_name(w);
+	info->wm_class = request_wm_class(w);
+	info->normal_hints = request_normal_hints(w);
+	info->transient_for = request_property(w, XA_WM_TRANSIENT_FOR,
+	    XA_WINDOW, 1);
+	info->window_type = request_window_type(w);
+	info->attr = xcb_get_window_attributes(conn, w);
+	info->geom = xcb_get_geometry(conn, w);
+}
 
-	update_window_name(win);
+/* Fill in the window from the replies to window_info_request. */
+static void
+window_info_apply(rp_window *win, struct window_info *info)
+{
+	xcb_connection_t *conn = XGetXCBConnection(dpy);
+	xcb_get_window_attributes_reply_t *attr;
+	xcb_get_geometry_reply_t *geom;
+	xcb_generic_error_t *error = NULL;
 
-	/* Get the WM Hints */
-	update_normal_hints(win);
+	window_name_from_replies(win, info->net_wm_name, info->wm_name,
+	    info->wm_class);
 
-	/* Get the colormap */
-	XGetWindowAttributes(dpy, win->w, &attr);
-	win->colormap = attr.colormap;
-	win->x = attr.x;
-	win->y = attr.y;
-	win->width = attr.width;
-	win->height = attr.height;
-	win->border = attr.border_width;
+	/* Get the WM Hints */
+	normal_hints_from_reply(property_reply(info->normal_hints),
+	    win->hints);
+	sanitize_normal_hints(win);
 
 	/* Transient status */
-	win->transient = XGetTransientForHint(dpy, win->w, &win->transient_for);
-
-	if (get_net_wm_window_type(win) == _net_wm_window_type_dialog)
+	win->transient_for = property_long(property_reply(
+	    info->transient_for), None);
+	win->transient = (win->transient_for != None);
+
+	win->window_type = property_long(property_reply(info->window_type),
+	    None);
+	win->cached |= WIN_CACHE_WINDOW_TYPE;
+	if (win->window_type == _net_wm_window_type_dialog)
 		win->transient = 1;
 
+	/* Get the colormap */
+	attr = xcb_get_window_attributes_reply(conn, info->attr, &error);
+	free(error);
+	if (attr != NULL)
+		win->colormap = attr->colormap;
+	free(attr);
+
+	error = NULL;
+	geom = xcb_get_geometry_reply(conn, info->geom, &error);
+	free(error);
+	if (geom != NULL) {
+		win->x = geom->x;
+		win->y = geom->y;
+		win->width = geom->width;
+		win->height = geom->height;
+		win->border = geom->border_width;
+	}
+	free(geom);
+
 	PRINT_DEBUG(("update_window_information: x:%d y:%d width:%d height:%d "
 	    "transient:%d\n", win->x, win->y, win->width, win->height,
 	    win->transient));
@@ -401,69 +643,206 @@ update_window_information(rp_window *win)
 	update_window_gravity(win);
 }
 
+void
+update_window_information(rp_window *win)
+{
+	struct window_info info;
+
+	window_info_request(win->w, &info);
+	window_info_apply(win, &info);
+}
+
 void
 unmanage(rp_window *w)
 {
 	list_del(&w->node);
+	window_hash_del(w);
 	vscreen_del_window(w->vscreen, w);
 
-	remove_atom(rp_glob_screen.root, _net_client_list, XA_WINDOW, w->w);
-	remove_atom(rp_glob_screen.root, _net_client_list_stacking, XA_WINDOW,
-	    w->w);
-
 	free_window(w);
 }
 
-/* When starting up scan existing windows and start managing them. */
+/* A top-level window found by scanwins, and what was asked about it. */
+struct scan_window {
+	Window w;
+	xcb_get_window_attributes_cookie_t attr_cookie;
+	xcb_get_geometry_cookie_t geom_cookie;
+	xcb_get_property_cookie_t state_cookie;
+	xcb_get_property_cookie_t net_wm_name_cookie;
+	xcb_get_property_cookie_t wm_name_cookie;
+	xcb_get_property_cookie_t type_cookie;
+
+	XWindowAttributes attr;
+	long state;
+
+	/* Whether to map the window, and what mapping it needs to know. */
+	int map;
+	struct window_info info;
+};
+
+/*
+ * Look at the reply to everything scanwins asked about a window and return 1
+ * if it should be adopted.
+ */
+static int
+scan_window_reply(xcb_connection_t *conn, struct scan_window *sw)
+{
+	xcb_get_window_attributes_reply_t *attr;
+	xcb_get_geometry_reply_t *geom;
+	xcb_generic_error_t *error = NULL;
+	char *wname;
+	Atom type;
+	int adopt;
+
+	attr = xcb_get_window_attributes_reply(conn, sw->attr_cookie, &error);
+	free(error);
+	error = NULL;
+	geom = xcb_get_geometry_reply(conn, sw->geom_cookie, &error);
+	free(error);
+	sw->state = property_long(property_reply(sw->state_cookie),
+	    WithdrawnState);
+
+	adopt = (attr != NULL && geom != NULL && !attr->override_redirect);
+
+	if (unmanaged_window_list) {
+		wname = wmname_from_replies(
+		    property_reply(sw->net_wm_name_cookie),
+		    property_reply(sw->wm_name_cookie));
+		type = property_long(property_reply(sw->type_cookie), None);
+		if (wname != NULL &&
+		    (unmanaged_name(wname) || unmanaged_type(type)))
+			adopt = 0;
+		free(wname);
+	}
+
+	if (adopt) {
+		memset(&sw->attr, 0, sizeof(sw->attr));
+		sw->attr.x = geom->x;
+		sw->attr.y = geom->y;
+		sw->attr.width = geom->width;
+		sw->attr.height = geom->height;
+		sw->attr.border_width = geom->border_width;
+		sw->attr.map_state = attr->map_state;
+		sw->attr.override_redirect = attr->override_redirect;
+		sw->attr.colormap = attr->colormap;
+
+		/* Collect mapped and iconized windows. */
+		sw->map = (sw->attr.map_state == IsViewable ||
+		    (sw->attr.map_state == IsUnmapped &&
+		    sw->state == IconicState));
+	}
+
+	free(attr);
+	free(geom);
+	return adopt;
+}
+
+/*
+ * When starting up scan existing windows and start managing them.
+ *
+ * The server is grabbed only while looking at them, so that no window comes
+ * or goes in the meantime.  Everything needed about every window is asked for
+ * before waiting for the first reply, so this costs about one round trip
+ * however many windows there are.  Adopting the windows then happens with the
+ * server released, since it involves the clients.
+ */
 void
 scanwins(void)
 {
+	xcb_connection_t *conn = XGetXCBConnection(dpy);
+	struct scan_window *scan;
 	rp_window *win;
-	XWindowAttributes attr;
-	unsigned int i, nwins;
+	unsigned int i, n, nwins;
 	Window dw1, dw2, *wins;
 
-	XQueryTree(dpy, rp_glob_screen.root, &dw1, &dw2, &wins, &nwins);
+	XGrabServer(dpy);
+
+	if (!XQueryTree(dpy, rp_glob_screen.root, &dw1, &dw2, &wins, &nwins))
+		nwins = 0;
 	PRINT_DEBUG(("windows: %d\n", nwins));
 
-	for (i = 0; i < nwins; i++) {
-		rp_screen *screen;
+	scan = xmalloc(sizeof(struct scan_window) * (nwins ? nwins : 1));
+
+	for (i = 0, n = 0; i < nwins; i++) {
+		struct scan_window *sw = &scan[n];
 
-		XGetWindowAttributes(dpy, wins[i], &attr);
-		if (is_rp_window(wins[i])
-		    || attr.override_redirect == True
-		    || unmanaged_window(wins[i]))
+		if (is_rp_window(wins[i]))
 			continue;
 
-		screen = find_screen_by_attr(attr);
+		sw->w = wins[i];
+		sw->attr_cookie = xcb_get_window_attributes(conn, sw->w);
+		sw->geom_cookie = xcb_get_geometry(conn, sw->w);
+		sw->state_cookie = request_wm_state(sw->w);
+		if (unmanaged_window_list) {
+			sw->net_wm_name_cookie = request_net_wm_name(sw->w);
+			sw->wm_name_cookie = request_wm_name(sw->w);
+			sw->type_cookie = request_window_type(sw->w);
+		}
+		n++;
+	}
+
+	for (i = 0, nwins = n, n = 0; i < nwins; i++) {
+		if (scan_window_reply(conn, &scan[i]))
+			scan[n++] = scan[i];
+	}
+
+	XUngrabServer(dpy);
+
+	/* Likewise ask for everything mapping the windows needs up front. */
+	for (i = 0; i < n; i++) {
+		if (scan[i].map)
+			window_info_request(scan[i].w, &scan[i].info);
+	}
+	XFlush(dpy);
+
+	for (i = 0; i < n; i++) {
+		struct scan_window *sw = &scan[i];
+		rp_screen *screen;
+
+		screen = find_screen_by_attr(sw->attr);
 		if (!screen)
 			list_first(screen, &rp_screens, node);
 
-		win = add_to_window_list(screen, wins[i]);
+		win = add_to_window_list(screen, sw->w);
+		win->wm_state = sw->state;
+		win->cached |= WIN_CACHE_WM_STATE;
 
 		PRINT_DEBUG(("map_state: %s\n",
-			attr.map_state == IsViewable ? "IsViewable" :
-			attr.map_state == IsUnviewable ? "IsUnviewable" :
+			sw->attr.map_state == IsViewable ? "IsViewable" :
+			sw->attr.map_state == IsUnviewable ? "IsUnviewable" :
 			"IsUnmapped"));
 		PRINT_DEBUG(("state: %s\n",
-			get_state(win) == IconicState ? "Iconic" :
-			get_state(win) == NormalState ? "Normal" : "Other"));
+			sw->state == IconicState ? "Iconic" :
+			sw->state == NormalState ? "Normal" : "Other"));
 
-		/* Collect mapped and iconized windows. */
-		if (attr.map_state == IsViewable
-		    || (attr.map_state == IsUnmapped
-			&& get_state(win) == IconicState))
-			map_window(win);
+		if (sw->map)
+			map_window_info(win, &sw->info);
 	}
 
-	XFree(wins);
+	free(scan);
+	if (wins)
+		XFree(wins);
+}
+
+/* Whether the window name is one the user asked not to manage. */
+static int
+unmanaged_name(const char *wname)
+{
+	int i;
+
+	for (i = 0; i < num_unmanaged_windows; i++) {
+		if (!strcmp(unmanaged_window_list[i], wname))
+			return 1;
+	}
+
+	return 0;
 }
 
 int
 unmanaged_window(Window w)
 {
 	char *wname;
-	int i;
+	int ret;
 
 	if (!unmanaged_window_list)
 		return 0;
@@ -472,19 +851,10 @@ unmanaged_window(Window w)
 	if (!wname)
 		return 0;
 
-	for (i = 0; i < num_unmanaged_windows; i++) {
-		if (!strcmp(unmanaged_window_list[i], wname)) {
-			free(wname);
-			return 1;
-		}
-	}
-
+	ret = unmanaged_name(wname) || is_unmanaged_window_type(w);
 	free(wname);
 
-	if (is_unmanaged_window_type(w))
-		return 1;
-
-	return 0;
+	return ret;
 }
 
 /* Set the state of the window. */
@@ -495,54 +865,95 @@ set_state(rp_window *win, int state)
 
 	win->state = state;
 
+	if ((win->cached & WIN_CACHE_WM_STATE) && win->wm_state == state)
+		return;
+
 	data[0] = (long) win->state;
 	data[1] = (long) None;
 
 	set_atom(win->w, wm_state, wm_state, data, 2);
+
+	win->wm_state = state;
+	win->cached |= WIN_CACHE_WM_STATE;
+	win->wm_state_writes++;
 }
 
 /* Get the WM state of the window. */
 long
 get_state(rp_window *win)
 {
-	long state = WithdrawnState;
+	if (win == NULL)
+		return WithdrawnState;
+
+	if (!(win->cached & WIN_CACHE_WM_STATE)) {
+		win->wm_state = window_wm_state(win->w);
+		win->cached |= WIN_CACHE_WM_STATE;
+	}
+	return win->wm_state;
+}
+
+static xcb_get_property_cookie_t
+request_wm_state(Window w)
+{
+	return request_property(w, wm_state, wm_state, 2);
+}
+
+static long
+window_wm_state(Window w)
+{
+	return property_long(property_reply(request_wm_state(w)),
+	    WithdrawnState);
+}
+
+/* Make sure our copy of the window's _NET_WM_STATE is current. */
+static void
+fetch_net_wm_state(rp_window *win)
+{
 	Atom type;
 	int format;
-	unsigned long nitems;
-	unsigned long bytes_left;
+	unsigned long nitems, bytes_left;
 	unsigned char *data;
 
-	if (win == NULL)
-		return state;
+	if (win->cached & WIN_CACHE_NET_WM_STATE)
+		return;
 
-	if (XGetWindowProperty(dpy, win->w, wm_state, 0L, 2L, False, wm_state,
-	    &type, &format, &nitems, &bytes_left, &data) == Success &&
-	    nitems > 0) {
-		state = *(long *)data;
-		XFree(data);
+	free(win->net_wm_state);
+	win->net_wm_state = NULL;
+	win->net_wm_state_len = 0;
+
+	if (XGetWindowProperty(dpy, win->w, _net_wm_state, 0, 1024L, False,
+	    XA_ATOM, &type, &format, &nitems, &bytes_left,
+	    &data) == Success) {
+		if (format == 32 && nitems > 0) {
+			win->net_wm_state = xmalloc(nitems *
+			    sizeof(unsigned long));
+			memcpy(win->net_wm_state, data,
+			    nitems * sizeof(unsigned long));
+			win->net_wm_state_len = nitems;
+		}
+		if (data)
+			XFree(data);
 	}
-	return state;
+
+	win->cached |= WIN_CACHE_NET_WM_STATE;
 }
 
 void
 check_state(rp_window *win)
 {
-	Atom state;
-	unsigned long read, left;
-	int i, fs = 0;
+	unsigned long i;
+	int fs = 0;
 
-	for (i = 0, left = 1; left; i += read) {
-		read = get_atom(win->w, _net_wm_state, XA_ATOM, i, &state, 1,
-		    &left);
-		if (!read)
-			break;
+	fetch_net_wm_state(win);
 
-		if (state == _net_wm_state_fullscreen) {
+	for (i = 0; i < win->net_wm_state_len; i++) {
+		if (win->net_wm_state[i] == _net_wm_state_fullscreen) {
 			fs = 1;
 			window_full_screen(win);
 		} else {
 			PRINT_DEBUG(("unhandled window state %ld (%s)\n",
-			    state, XGetAtomName(dpy, state)));
+			    win->net_wm_state[i],
+			    XGetAtomName(dpy, win->net_wm_state[i])));
 		}
 	}
 
@@ -550,6 +961,80 @@ check_state(rp_window *win)
 		window_full_screen(NULL);
 }
 
+/* Replace the window's _NET_WM_STATE, unless it already holds just atoms. */
+void
+set_net_wm_state(rp_window *win, unsigned long *atoms, unsigned long n)
+{
+	/* Deleting a property that isn't there doesn't notify anyone. */
+	if (n == 0)
+		fetch_net_wm_state(win);
+
+	if ((win->cached & WIN_CACHE_NET_WM_STATE) &&
+	    win->net_wm_state_len == n &&
+	    (n == 0 || !memcmp(win->net_wm_state, atoms,
+	    n * sizeof(unsigned long))))
+		return;
+
+	if (n)
+		set_atom(win->w, _net_wm_state, XA_ATOM, atoms, n);
+	else
+		XDeleteProperty(dpy, win->w, _net_wm_state);
+
+	win->net_wm_state_writes++;
+
+	free(win->net_wm_state);
+	win->net_wm_state = NULL;
+	if (n) {
+		win->net_wm_state = xmalloc(n * sizeof(unsigned long));
+		memcpy(win->net_wm_state, atoms, n * sizeof(unsigned long));
+	}
+	win->net_wm_state_len = n;
+	win->cached |= WIN_CACHE_NET_WM_STATE;
+}
+
+/* Drop atom from the window's _NET_WM_STATE if it is there. */
+void
+remove_net_wm_state(rp_window *win, unsigned long atom)
+{
+	unsigned long *atoms, i, n = 0;
+
+	fetch_net_wm_state(win);
+
+	atoms = xmalloc((win->net_wm_state_len + 1) * sizeof(unsigned long));
+	for (i = 0; i < win->net_wm_state_len; i++)
+		if (win->net_wm_state[i] != atom)
+			atoms[n++] = win->net_wm_state[i];
+
+	if (n != win->net_wm_state_len)
+		set_net_wm_state(win, atoms, n);
+
+	free(atoms);
+}
+
+/*
+ * Account for a PropertyNotify on one of the properties we keep a copy of.
+ * Return 1 if somebody else changed it and the copy was dropped, 0 if it was
+ * only the echo of our own write.
+ */
+int
+uncache_window_property(rp_window *win, unsigned int which)
+{
+	int *writes = NULL;
+
+	if (which == WIN_CACHE_WM_STATE)
+		writes = &win->wm_state_writes;
+	else if (which == WIN_CACHE_NET_WM_STATE)
+		writes = &win->net_wm_state_writes;
+
+	if (writes && *writes > 0) {
+		(*writes)--;
+		return 0;
+	}
+
+	win->cached &= ~which;
+	return 1;
+}
+
 static void
 move_window(rp_window *win)
 {
@@ -782,8 +1267,6 @@ maximize(rp_window *win)
 	/* Actually do the maximizing. */
 	XMoveResizeWindow(dpy, win->w, win->x, win->y, win->width, win->height);
 	XSetWindowBorderWidth(dpy, win->w, win->border);
-
-	XSync(dpy, False);
 }
 
 /*
@@ -830,13 +1313,23 @@ force_maximize(rp_window *win)
 /* map the unmapped window win */
 void
 map_window(rp_window *win)
+{
+	struct window_info info;
+
+	window_info_request(win->w, &info);
+	map_window_info(win, &info);
+}
+
+/* Map the window, given the requests made about it by window_info_request. */
+static void
+map_window_info(rp_window *win, struct window_info *info)
 {
 	rp_window *transfor;
 
 	PRINT_DEBUG(("Mapping the unmapped window %s\n", window_name(win)));
 
 	/* Fill in the necessary data about the window */
-	update_window_information(win);
+	window_info_apply(win, info);
 
 	if (win->transient_for &&
 	    (transfor = find_window(win->transient_for))) {
@@ -847,6 +1340,7 @@ map_window(rp_window *win)
 	}
 
 	win->number = numset_request(rp_window_numset);
+	window_set_number_index(win->number, win);
 	grab_top_level_keys(win->w);
 
 	/* Put win in the mapped window list */
@@ -872,12 +1366,9 @@ map_window(rp_window *win)
 	else
 		show_rudeness_msg(win, 0);
 
-	append_atom(rp_glob_screen.root, _net_client_list, XA_WINDOW, &win->w,
-	    1);
-	append_atom(rp_glob_screen.root, _net_client_list_stacking, XA_WINDOW,
-	    &win->w, 1);
+	client_list_add(win);
 
-	hook_run(&rp_new_window_hook);
+	hook_run_window(&rp_new_window_hook, win);
 }
 
 void
@@ -908,7 +1399,7 @@ unhide_window(rp_window * win)
 		return;
 
 	/* Always raise the window. */
-	XRaiseWindow(dpy, win->w);
+	raise_window(win);
 
 	if (win->state != IconicState)
 		return;
@@ -947,6 +1438,7 @@ withdraw_window(rp_window *win)
 		    window_name(win));
 
 	numset_release(rp_window_numset, win->number);
+	window_set_number_index(win->number, NULL);
 	win->number = -1;
 
 	list_move_tail(&win->node, &rp_unmapped_window);
@@ -958,12 +1450,13 @@ withdraw_window(rp_window *win)
 
 	XRemoveFromSaveSet(dpy, win->w);
 	set_state(win, WithdrawnState);
+	client_list_remove(win);
 	XSync(dpy, False);
 
 	ignore_badwindow--;
 
 	/* Call our hook */
-	hook_run(&rp_delete_window_hook);
+	hook_run_window(&rp_delete_window_hook, win);
 }
 
 /* Hide all other mapped windows except for win in win's frame. */
@@ -34,6 +34,9 @@ void rename_current_window(void);
 void set_state(rp_window *win, int state);
 long get_state(rp_window *win);
 void check_state(rp_window *win);
+void set_net_wm_state(rp_window *win, unsigned long *atoms, unsigned long n);
+void remove_net_wm_state(rp_window *win, unsigned long atom);
+int uncache_window_property(rp_window *win, unsigned int which);
 
 int window_is_transient(rp_window *win);
 Atom get_net_wm_window_type(rp_window *win);
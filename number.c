@@ -19,83 +19,80 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <err.h>
 
 #include "sdorfehs.h"
 
 /* Keep track of a set of numbers. For frames and windows. */
 struct numset {
-	/* A list of the numbers taken. */
-	int *numbers_taken;
+	/* A bitmap of the numbers taken, bit n of the set is number n. */
+	unsigned long *words;
 
-	/*
-	 * the number of numbers currently stored in the numbers_taken array.
-	 */
-	int num_taken;
+	/* the size of the words array. */
+	int nwords;
 
-	/* the size of the numbers_taken array. */
-	int max_taken;
+	/* All words before this one are known to be full. */
+	int first_free;
 };
 
+#define NUMSET_WORD_BITS ((int)(sizeof(unsigned long) * 8))
+
 /* Initialize a numset structure. */
 static void
 numset_init(struct numset *ns)
 {
-	ns->max_taken = 10;
-	ns->num_taken = 0;
+	ns->nwords = 1;
+	ns->first_free = 0;
 
-	ns->numbers_taken = xmalloc(ns->max_taken * sizeof(int));
+	ns->words = xmalloc(ns->nwords * sizeof(unsigned long));
+	memset(ns->words, 0, ns->nwords * sizeof(unsigned long));
 }
 
-static int
-numset_num_is_taken(struct numset *ns, int n)
+/* Make sure the bitmap can hold number n. */
+static void
+numset_grow(struct numset *ns, int n)
 {
-	int i;
+	int nwords = ns->nwords;
 
-	for (i = 0; i < ns->num_taken; i++) {
-		if (ns->numbers_taken[i] == n)
-			return 1;
-	}
-	return 0;
+	while (n / NUMSET_WORD_BITS >= nwords)
+		nwords *= 2;
+	if (nwords == ns->nwords)
+		return;
+
+	ns->words = xrealloc(ns->words, nwords * sizeof(unsigned long));
+	memset(ns->words + ns->nwords, 0,
+	    (nwords - ns->nwords) * sizeof(unsigned long));
+	ns->nwords = nwords;
 }
 
-/* returns index into numbers_taken that can be used. */
 static int
-numset_find_empty_cell(struct numset *ns)
+numset_set(struct numset *ns, int n)
 {
-	int i;
+	unsigned long bit;
 
-	for (i = 0; i < ns->num_taken; i++) {
-		if (ns->numbers_taken[i] == -1)
-			return i;
-	}
+	numset_grow(ns, n);
 
-	/* no vacant ones, so grow the array. */
-	if (ns->num_taken >= ns->max_taken) {
-		ns->max_taken *= 2;
-		ns->numbers_taken = xrealloc(ns->numbers_taken,
-		    sizeof(int) * ns->max_taken);
-	}
-	ns->num_taken++;
+	bit = 1UL << (n % NUMSET_WORD_BITS);
+	if (ns->words[n / NUMSET_WORD_BITS] & bit)
+		return 0;	/* failed. */
 
-	return ns->num_taken - 1;
+	ns->words[n / NUMSET_WORD_BITS] |= bit;
+	return 1;	/* success! */
 }
 
 int
 numset_add_num(struct numset *ns, int n)
 {
-	int ec;
+	/* Negative numbers are never handed out, so they can't clash. */
+	if (n < 0)
+		return 1;
 
-	if (numset_num_is_taken(ns, n))
-		return 0;	/* failed. */
+	/* Don't let an arbitrary number size the bitmap. */
+	if (n > NUMSET_MAX)
+		return 0;
 
-	/*
-	 * numset_find_empty_cell calls realloc on numbers_taken. So store the
-	 * ret val in ec then use ec as an index into the array.
-	 */
-	ec = numset_find_empty_cell(ns);
-	ns->numbers_taken[ec] = n;
-	return 1;	/* success! */
+	return numset_set(ns, n);
 }
 
 /*
@@ -105,16 +102,22 @@ numset_add_num(struct numset *ns, int n)
 int
 numset_request(struct numset *ns)
 {
-	int i;
+	int i, n;
 
-	/*
-	 * look for a unique number, and add it to the list of taken numbers.
-	 */
-	i = 0;
-	while (!numset_add_num(ns, i))
-		i++;
+	/* look for the first word with a zero bit and take the lowest one. */
+	for (i = ns->first_free; i < ns->nwords; i++) {
+		if (~ns->words[i] != 0)
+			break;
+	}
+	ns->first_free = i;
 
-	return i;
+	if (i == ns->nwords)
+		n = i * NUMSET_WORD_BITS;
+	else
+		n = i * NUMSET_WORD_BITS + __builtin_ctzl(~ns->words[i]);
+
+	numset_set(ns, n);
+	return n;
 }
 
 /*
@@ -124,17 +127,17 @@ numset_request(struct numset *ns)
 void
 numset_release(struct numset *ns, int n)
 {
-	int i;
-
-	if (n < 0)
+	if (n < 0) {
 		warnx("ns=%p attempt to release %d!", ns, n);
-
-	for (i = 0; i < ns->num_taken; i++) {
-		if (ns->numbers_taken[i] == n) {
-			ns->numbers_taken[i] = -1;
-			return;
-		}
+		return;
 	}
+
+	if (n / NUMSET_WORD_BITS >= ns->nwords)
+		return;
+
+	ns->words[n / NUMSET_WORD_BITS] &= ~(1UL << (n % NUMSET_WORD_BITS));
+	if (n / NUMSET_WORD_BITS < ns->first_free)
+		ns->first_free = n / NUMSET_WORD_BITS;
 }
 
 /* Create a new numset and return a pointer to it. */
@@ -152,6 +155,6 @@ numset_new(void)
 void
 numset_free(struct numset *ns)
 {
-	free(ns->numbers_taken);
+	free(ns->words);
 	free(ns);
 }
@@ -20,6 +20,14 @@
 #ifndef _SDORFEHS_NUMBER_H
 #define _SDORFEHS_NUMBER_H 1
 
+/*
+ * The largest number numset_add_num accepts.  Numbers index arrays and
+ * bitmaps, so letting the user pick any int would let a single command
+ * allocate gigabytes.  Numbers handed out by numset_request are dense and
+ * not bounded by this.
+ */
+#define NUMSET_MAX	9999
+
 struct numset;
 
 struct numset *numset_new(void);
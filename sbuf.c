@@ -162,6 +162,18 @@ sbuf_utf8_nconcat(struct sbuf *b, const char *s, int width)
 	return b->data;
 }
 
+/* Drop the first n bytes of the buffer. */
+void
+sbuf_consume(struct sbuf *b, size_t n)
+{
+	if (n > b->len)
+		n = b->len;
+
+	memmove(b->data, b->data + n, b->len - n);
+	b->len -= n;
+	b->data[b->len] = '\0';
+}
+
 void
 sbuf_chop(struct sbuf *b)
 {
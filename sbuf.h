@@ -43,5 +43,6 @@ char *sbuf_get(struct sbuf *b);
 char *sbuf_printf(struct sbuf *b, char *fmt,...);
 char *sbuf_printf_concat(struct sbuf *b, char *fmt,...);
 void sbuf_chop(struct sbuf *b);
+void sbuf_consume(struct sbuf *b, size_t n);
 
 #endif	/* ! _SDORFEHS_SBUF_H */
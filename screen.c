@@ -426,7 +426,9 @@ init_screen(rp_screen *s)
 	if (!s->xft_font)
 		errx(1, "failed to open default font \"%s\"", DEFAULT_XFT_FONT);
 
-	memset(s->xft_font_cache, 0, sizeof(s->xft_font_cache));
+	rp_init_font(&s->xft_default_font, NULL, s->xft_font);
+	INIT_LIST_HEAD(&s->xft_font_cache);
+	s->xft_font_cache_count = 0;
 
 	if (!XftColorAllocName(dpy, DefaultVisual(dpy, screen_num),
 	    DefaultColormap(dpy, screen_num),
@@ -629,13 +631,9 @@ screen_update(rp_screen *s, int left, int top, int width, int height)
 	    s->height);
 
 	list_for_each_entry(v, &s->vscreens, node) {
-		list_for_each_entry(f, &v->frames, node) {
-			f->x = (f->x * width) / oldwidth;
-			f->width = (f->width * width) / oldwidth;
-			f->y = (f->y * height) / oldheight;
-			f->height = (f->height * height) / oldheight;
+		scale_frames(v, oldwidth, oldheight);
+		list_for_each_entry(f, &v->frames, node)
 			maximize_all_windows_in_frame(f);
-		}
 	}
 
 	screen_update_workarea(s);
@@ -674,6 +672,9 @@ screen_update_frames(rp_screen *s)
 
 			maximize_all_windows_in_frame(f);
 		}
+
+		/* Only the outer frames moved, so recompute the ratios. */
+		split_tree_invalidate(v);
 	}
 
 	redraw_sticky_bar_text(1);
@@ -755,6 +756,9 @@ screen_free(rp_screen *s)
 {
 	deactivate_screen(s);
 
+	rp_clear_cached_draws(s);
+	rp_clear_cached_colors(s);
+
 	XDestroyWindow(dpy, s->bar_window);
 	XDestroyWindow(dpy, s->key_window);
 	XDestroyWindow(dpy, s->input_window);
@@ -768,6 +772,7 @@ screen_free(rp_screen *s)
 		    DefaultColormap(dpy, s->screen_num), &s->xft_bgcolor);
 		XftFontClose(dpy, s->xft_font);
 	}
+	rp_clear_font_widths(&s->xft_default_font);
 	rp_clear_cached_fonts(s);
 
 	XFreeCursor(dpy, s->rat);
@@ -41,18 +41,14 @@ static void
 sighandler(int signum)
 {
 	kill_signalled++;
+	signal_wakeup();
 }
 
 static void
 hup_handler(int signum)
 {
 	hup_signalled++;
-}
-
-static void
-alrm_handler(int signum)
-{
-	alarm_signalled++;
+	signal_wakeup();
 }
 
 static int
@@ -182,6 +178,7 @@ init_defaults(void)
 	defaults.bar_border_width = 0;
 	defaults.bar_in_padding = 1;
 	defaults.bar_sticky = 1;
+	defaults.bar_max_fps = 30;
 
 	defaults.frame_indicator_timeout = 1;
 	defaults.frame_resize_unit = 10;
@@ -215,6 +212,8 @@ init_defaults(void)
 	defaults.window_list_style = STYLE_COLUMN;
 
 	defaults.history_size = 20;
+	defaults.history_compaction = 1;
+	defaults.font_cache_size = 5;
 	defaults.frame_selectors = xstrdup("");
 	defaults.maxundos = 20;
 
@@ -242,12 +241,6 @@ main(int argc, char *argv[])
 
 	setlocale(LC_CTYPE, "");
 
-	if (XSupportsLocale()) {
-		if (!XSetLocaleModifiers(""))
-			warnx("couldn't set X locale modifiers");
-	} else
-		warnx("X doesn't seem to support your locale");
-
 	/* Parse the arguments */
 	myargv = argv;
 	while ((c = getopt(argc, argv, "c:d:hif:")) != -1) {
@@ -282,39 +275,54 @@ main(int argc, char *argv[])
 		fputc('\n', stderr);
 		exit(1);
 	}
-	if (!(dpy = XOpenDisplay(display)))
-		errx(1, "can't open display %s", display);
-	set_close_on_exec(ConnectionNumber(dpy));
-
-	/* forked commands should not get X console tty as their stdin */
-	fd = open("/dev/null", O_RDONLY);
-	dup2(fd, STDIN_FILENO);
-	close(fd);
-
-	/* Set our own specific Atoms. */
-	rp_selection = XInternAtom(dpy, "RP_SELECTION", False);
-
-	/* TEXT atoms */
-	xa_string = XA_STRING;
-	xa_compound_text = XInternAtom(dpy, "COMPOUND_TEXT", False);
-	xa_utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
 
 	init_control_socket_path();
 
+	/*
+	 * Commands only need the control socket, which doesn't depend on the
+	 * display, so don't pay for connecting to the X server.
+	 */
 	if (cmd_count > 0) {
 		int j, exit_status = 0;
 
 		for (j = 0; j < cmd_count; j++) {
-			if (!send_command(interactive, cmd[j]))
+			if (!strcmp(cmd[j], "-")) {
+				/* Stream commands from stdin. */
+				if (!send_command_stream(interactive,
+				    STDIN_FILENO))
+					exit_status = 1;
+			} else if (!send_command(interactive, cmd[j]))
 				exit_status = 1;
 			free(cmd[j]);
 		}
 
 		free(cmd);
-		XCloseDisplay(dpy);
 		return exit_status;
 	}
 
+	if (XSupportsLocale()) {
+		if (!XSetLocaleModifiers(""))
+			warnx("couldn't set X locale modifiers");
+	} else
+		warnx("X doesn't seem to support your locale");
+
+	if (!(dpy = XOpenDisplay(display)))
+		errx(1, "can't open display %s", display);
+	set_close_on_exec(ConnectionNumber(dpy));
+
+	/* Set our own specific Atoms. */
+	rp_selection = XInternAtom(dpy, "RP_SELECTION", False);
+
+	/* TEXT atoms */
+	xa_string = XA_STRING;
+	xa_compound_text = XInternAtom(dpy, "COMPOUND_TEXT", False);
+	xa_utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
+
+	/* forked commands should not get X console tty as their stdin */
+	fd = open("/dev/null", O_RDONLY);
+	dup2(fd, STDIN_FILENO);
+	close(fd);
+
 	/* For child processes to know */
 	snprintf(pid, sizeof(pid), "%d", getpid());
 	setenv("SDORFEHS_PID", pid, 1);
@@ -354,7 +362,7 @@ main(int argc, char *argv[])
 
 	/* Setup signal handlers. */
 	XSetErrorHandler(handler);
-	set_sig_handler(SIGALRM, alrm_handler);
+	init_signal_pipe();
 	set_sig_handler(SIGTERM, sighandler);
 	set_sig_handler(SIGINT, sighandler);
 	set_sig_handler(SIGHUP, hup_handler);
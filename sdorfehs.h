@@ -97,6 +97,7 @@ do {                                            \
 #include "xrandr.h"
 #include "format.h"
 #include "utf8.h"
+#include "timer.h"
 #include "util.h"
 
 #endif	/* ! _SDORFEHS_H */
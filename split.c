@@ -26,6 +26,474 @@
 #define VERTICALLY 0
 #define HORIZONTALLY 1
 
+/* Frames can't be made this small or smaller. */
+#define MIN_FRAME_SIZE ((defaults.window_border_width * 2) + \
+    (defaults.gap * 2))
+
+static struct rp_split *
+split_new(rp_frame *frame)
+{
+	struct rp_split *n;
+
+	n = xmalloc(sizeof(struct rp_split));
+	memset(n, 0, sizeof(struct rp_split));
+	n->frame = frame;
+	if (frame) {
+		frame->split = n;
+		n->x = frame->x;
+		n->y = frame->y;
+		n->width = frame->width;
+		n->height = frame->height;
+	}
+
+	return n;
+}
+
+static void
+split_free(struct rp_split *n)
+{
+	if (n == NULL)
+		return;
+
+	if (n->frame)
+		n->frame->split = NULL;
+	split_free(n->child[0]);
+	split_free(n->child[1]);
+	free(n);
+}
+
+/* Forget the split tree, e.g. because the frameset is being replaced. */
+void
+split_tree_invalidate(rp_vscreen *v)
+{
+	split_free(v->split_tree);
+	v->split_tree = NULL;
+}
+
+static int
+split_start(struct rp_split *n, int way)
+{
+	return way == VERTICALLY ? n->x : n->y;
+}
+
+static int
+split_extent(struct rp_split *n, int way)
+{
+	return way == VERTICALLY ? n->width : n->height;
+}
+
+/* Where child[1] of n starts. */
+static int
+split_line(struct rp_split *n)
+{
+	int extent = split_extent(n, n->way);
+	int cut = (int)(n->ratio * extent + 0.5);
+
+	if (cut < 1)
+		cut = 1;
+	if (cut > extent - 1)
+		cut = extent - 1;
+
+	return split_start(n, n->way) + cut;
+}
+
+/* Lay out the frames in n to fill the given area, following the ratios. */
+static void
+split_layout(struct rp_split *n, int x, int y, int width, int height)
+{
+	int line;
+
+	n->x = x;
+	n->y = y;
+	n->width = width;
+	n->height = height;
+
+	if (n->frame) {
+		n->frame->x = x;
+		n->frame->y = y;
+		n->frame->width = width;
+		n->frame->height = height;
+		return;
+	}
+
+	line = split_line(n);
+	if (n->way == VERTICALLY) {
+		split_layout(n->child[0], x, y, line - x, height);
+		split_layout(n->child[1], line, y, x + width - line, height);
+	} else {
+		split_layout(n->child[0], x, y, width, line - y);
+		split_layout(n->child[1], x, line, width, y + height - line);
+	}
+}
+
+/*
+ * Lay out n in a new area while keeping the lines between its frames where
+ * they are, as when one of its edges is moved.
+ */
+static void
+split_reflow(struct rp_split *n, int x, int y, int width, int height)
+{
+	int line;
+
+	if (n->frame) {
+		split_layout(n, x, y, width, height);
+		return;
+	}
+
+	line = split_line(n);
+	n->x = x;
+	n->y = y;
+	n->width = width;
+	n->height = height;
+	n->ratio = (double)(line - split_start(n, n->way)) /
+	    split_extent(n, n->way);
+
+	if (n->way == VERTICALLY) {
+		split_reflow(n->child[0], x, y, line - x, height);
+		split_reflow(n->child[1], line, y, x + width - line, height);
+	} else {
+		split_reflow(n->child[0], x, y, width, line - y);
+		split_reflow(n->child[1], x, line, width, y + height - line);
+	}
+}
+
+static int
+frame_start_cmp(const void *a, const void *b, int way)
+{
+	rp_frame *fa = *(rp_frame * const *)a, *fb = *(rp_frame * const *)b;
+
+	return way == VERTICALLY ? fa->x - fb->x : fa->y - fb->y;
+}
+
+static int
+frame_x_cmp(const void *a, const void *b)
+{
+	return frame_start_cmp(a, b, VERTICALLY);
+}
+
+static int
+frame_y_cmp(const void *a, const void *b)
+{
+	return frame_start_cmp(a, b, HORIZONTALLY);
+}
+
+/*
+ * Rebuild the splits that divide the given area into the frames, or return
+ * NULL if the frames don't tile it that way.
+ */
+static struct rp_split *
+split_build(rp_frame **frames, int nframes, int x, int y, int width,
+    int height)
+{
+	struct rp_split *n;
+	rp_frame *f;
+	int i, way, end, start;
+
+	if (nframes == 1) {
+		f = frames[0];
+		if (f->x != x || f->y != y || f->width != width ||
+		    f->height != height)
+			return NULL;
+		return split_new(f);
+	}
+
+	/* Look for a line crossing the whole area without cutting a frame. */
+	for (way = VERTICALLY; way <= HORIZONTALLY; way++) {
+		qsort(frames, nframes, sizeof(rp_frame *),
+		    way == VERTICALLY ? frame_x_cmp : frame_y_cmp);
+		start = way == VERTICALLY ? x : y;
+		end = start;
+		for (i = 0; i < nframes - 1; i++) {
+			f = frames[i];
+			if (way == VERTICALLY && f->x + f->width > end)
+				end = f->x + f->width;
+			else if (way == HORIZONTALLY && f->y + f->height > end)
+				end = f->y + f->height;
+			if (end == (way == VERTICALLY ? frames[i + 1]->x :
+			    frames[i + 1]->y))
+				break;
+		}
+		if (i < nframes - 1 && end > start)
+			break;
+	}
+	if (way > HORIZONTALLY)
+		return NULL;
+
+	n = split_new(NULL);
+	n->way = way;
+	n->x = x;
+	n->y = y;
+	n->width = width;
+	n->height = height;
+	n->ratio = (double)(end - start) /
+	    (way == VERTICALLY ? width : height);
+
+	if (way == VERTICALLY) {
+		n->child[0] = split_build(frames, i + 1, x, y, end - x,
+		    height);
+		n->child[1] = split_build(frames + i + 1, nframes - i - 1,
+		    end, y, x + width - end, height);
+	} else {
+		n->child[0] = split_build(frames, i + 1, x, y, width,
+		    end - y);
+		n->child[1] = split_build(frames + i + 1, nframes - i - 1,
+		    x, end, width, y + height - end);
+	}
+	if (n->child[0] == NULL || n->child[1] == NULL) {
+		split_free(n);
+		return NULL;
+	}
+	n->child[0]->parent = n;
+	n->child[1]->parent = n;
+
+	return n;
+}
+
+/*
+ * Return the split tree of the vscreen, building it from the frames if
+ * needed.  Returns NULL if the frames weren't laid out by splitting, e.g.
+ * after restoring an arbitrary frameset.
+ */
+static struct rp_split *
+split_tree(rp_vscreen *v)
+{
+	rp_frame **frames, *f;
+	int i, n, left = 0, top = 0, right = 0, bottom = 0;
+
+	if (v->split_tree)
+		return v->split_tree;
+
+	n = num_frames(v);
+	frames = xmalloc(n * sizeof(rp_frame *));
+	i = 0;
+	list_for_each_entry(f, &v->frames, node) {
+		if (i == 0) {
+			left = f->x;
+			top = f->y;
+			right = f->x + f->width;
+			bottom = f->y + f->height;
+		}
+		if (f->x < left)
+			left = f->x;
+		if (f->y < top)
+			top = f->y;
+		if (f->x + f->width > right)
+			right = f->x + f->width;
+		if (f->y + f->height > bottom)
+			bottom = f->y + f->height;
+		frames[i++] = f;
+	}
+
+	if (n > 0)
+		v->split_tree = split_build(frames, n, left, top,
+		    right - left, bottom - top);
+	free(frames);
+
+	PRINT_DEBUG(("split tree for %d frames: %s\n", n,
+	    v->split_tree ? "built" : "not tiled"));
+
+	return v->split_tree;
+}
+
+/*
+ * Will every frame in n that touches its far (or near) edge along the way
+ * still be big enough if that edge moves, changing their size by grow?
+ */
+static int
+split_edge_fits(struct rp_split *n, int way, int far, int grow)
+{
+	if (n->frame)
+		return split_extent(n, way) + grow > MIN_FRAME_SIZE;
+
+	if (n->way == way)
+		return split_edge_fits(n->child[far ? 1 : 0], way, far, grow);
+
+	return split_edge_fits(n->child[0], way, far, grow) &&
+	    split_edge_fits(n->child[1], way, far, grow);
+}
+
+static void
+split_maximize_windows(struct rp_split *n, int raise)
+{
+	if (n->frame) {
+		maximize_all_windows_in_frame(n->frame);
+		if (raise && n->frame->win_number != EMPTY)
+			raise_window(find_window_number(n->frame->win_number));
+		return;
+	}
+
+	split_maximize_windows(n->child[0], raise);
+	split_maximize_windows(n->child[1], raise);
+}
+
+/*
+ * Take frame out of the split tree, giving its space to the frames on the
+ * other side of its split.  Returns the node holding those frames, or NULL if
+ * there is no tree to take it out of.
+ */
+static struct rp_split *
+split_remove(rp_frame *frame)
+{
+	rp_vscreen *v = frame->vscreen;
+	struct rp_split *leaf, *p, *sibling;
+
+	if (split_tree(v) == NULL || frame->split->parent == NULL)
+		return NULL;
+
+	leaf = frame->split;
+	p = leaf->parent;
+	sibling = p->child[p->child[0] == leaf ? 1 : 0];
+
+	sibling->parent = p->parent;
+	if (p->parent)
+		p->parent->child[p->parent->child[0] == p ? 0 : 1] = sibling;
+	else
+		v->split_tree = sibling;
+
+	split_layout(sibling, p->x, p->y, p->width, p->height);
+
+	frame->split = NULL;
+	free(leaf);
+	free(p);
+
+	return sibling;
+}
+
+/*
+ * Move the edge of frame that runs across the way by diff pixels, growing
+ * it.  Only the frames along the line the edge is on change size.  Returns
+ * -1 if the frame has no such edge or a frame would get too small.
+ */
+static int
+split_resize(rp_frame *frame, int way, int diff)
+{
+	struct rp_split *n, *p;
+	int line, far;
+
+	/* Move the far edge, or the near one if it's on the screen's edge. */
+	for (far = 1; far >= 0; far--) {
+		for (n = frame->split, p = n->parent; p;
+		    n = p, p = p->parent) {
+			if (p->way == way && p->child[far ? 0 : 1] == n)
+				break;
+		}
+		if (p)
+			break;
+	}
+	if (p == NULL)
+		return -1;
+
+	if (!far)
+		diff = -diff;
+	if (!split_edge_fits(p->child[0], way, 1, diff) ||
+	    !split_edge_fits(p->child[1], way, 0, -diff))
+		return -1;
+
+	line = split_line(p) + diff;
+	p->ratio = (double)(line - split_start(p, way)) /
+	    split_extent(p, way);
+
+	if (way == VERTICALLY) {
+		split_reflow(p->child[0], p->x, p->y, line - p->x, p->height);
+		split_reflow(p->child[1], line, p->y,
+		    p->x + p->width - line, p->height);
+	} else {
+		split_reflow(p->child[0], p->x, p->y, p->width, line - p->y);
+		split_reflow(p->child[1], p->x, line, p->width,
+		    p->y + p->height - line);
+	}
+	split_maximize_windows(p, 0);
+
+	return 0;
+}
+
+/*
+ * The frame in n nearest pos along the line at n's near edge, or at its far
+ * edge if n is before the line.
+ */
+static rp_frame *
+split_edge_frame(struct rp_split *n, int way, int after, int pos)
+{
+	while (n->frame == NULL) {
+		if (n->way == way)
+			n = n->child[after ? 0 : 1];
+		else
+			n = n->child[pos < split_line(n) ? 0 : 1];
+	}
+
+	return n->frame;
+}
+
+/*
+ * Find the frame across the line before (or after) frame along the way whose
+ * start is nearest frame's.
+ */
+static rp_frame *
+split_find_frame(rp_frame *frame, int way, int after)
+{
+	struct rp_split *n, *p;
+	rp_frame *a, *b;
+	int pos, end, a_end;
+	int other = (way == VERTICALLY) ? HORIZONTALLY : VERTICALLY;
+
+	for (n = frame->split, p = n->parent; p; n = p, p = p->parent) {
+		if (p->way == way && p->child[after ? 0 : 1] == n)
+			break;
+	}
+	if (p == NULL)
+		return NULL;
+	n = p->child[after ? 1 : 0];
+
+	/*
+	 * Frames along the line tile it, so the nearest one either holds
+	 * pos or is the one after it, if that one still borders frame.
+	 */
+	pos = split_start(frame->split, other);
+	end = pos + split_extent(frame->split, other);
+	a = split_edge_frame(n, way, after, pos);
+	a_end = split_start(a->split, other) + split_extent(a->split, other);
+	if (split_start(a->split, other) >= pos || a_end >= end)
+		return a;
+
+	b = split_edge_frame(n, way, after, a_end);
+	if (split_start(b->split, other) - pos <
+	    pos - split_start(a->split, other))
+		return b;
+
+	return a;
+}
+
+/*
+ * Scale the frames of v after its screen changed size, following the split
+ * tree if there is one.
+ */
+void
+scale_frames(rp_vscreen *v, int oldwidth, int oldheight)
+{
+	struct rp_split *t;
+	rp_frame *f;
+	int width = v->screen->width, height = v->screen->height;
+	int x, y, right, bottom;
+
+	if ((t = split_tree(v)) != NULL) {
+		x = (t->x * width) / oldwidth;
+		right = ((t->x + t->width) * width) / oldwidth;
+		y = (t->y * height) / oldheight;
+		bottom = ((t->y + t->height) * height) / oldheight;
+		split_layout(t, x, y, right - x, bottom - y);
+		return;
+	}
+
+	list_for_each_entry(f, &v->frames, node) {
+		f->width = ((f->x + f->width) * width) / oldwidth;
+		f->x = (f->x * width) / oldwidth;
+		f->width -= f->x;
+		f->height = ((f->y + f->height) * height) / oldheight;
+		f->y = (f->y * height) / oldheight;
+		f->height -= f->y;
+	}
+}
+
 static void
 update_last_access(rp_frame *frame)
 {
@@ -252,9 +720,13 @@ split_frame(rp_frame *frame, int way, int pixels)
 	rp_vscreen *v;
 	rp_window *win;
 	rp_frame *new_frame;
+	struct rp_split *n;
 
 	v = frame->vscreen;
 
+	/* Find the frame's leaf before the frameset changes. */
+	split_tree(v);
+
 	/* Make our new frame. */
 	new_frame = frame_new(v);
 
@@ -279,6 +751,17 @@ split_frame(rp_frame *frame, int way, int pixels)
 		frame->width = pixels;
 	}
 
+	/* The frame's leaf becomes a split between the two frames. */
+	if ((n = frame->split) != NULL) {
+		n->frame = NULL;
+		n->way = way;
+		n->ratio = (double)pixels / split_extent(n, way);
+		n->child[0] = split_new(frame);
+		n->child[1] = split_new(new_frame);
+		n->child[0]->parent = n;
+		n->child[1]->parent = n;
+	}
+
 	win = find_window_for_frame(new_frame);
 	if (win) {
 		PRINT_DEBUG(("Found a window for the frame!\n"));
@@ -296,7 +779,7 @@ split_frame(rp_frame *frame, int way, int pixels)
 	/* resize the existing frame */
 	if (frame->win_number != EMPTY) {
 		maximize_all_windows_in_frame(frame);
-		XRaiseWindow(dpy, find_window_number(frame->win_number)->w);
+		raise_window(find_window_number(frame->win_number));
 	}
 	update_bar(v->screen);
 	show_frame_indicator(0);
@@ -338,6 +821,8 @@ remove_all_splits(void)
 			win->sticky_frame = EMPTY;
 	}
 
+	split_tree_invalidate(v);
+
 	/* Delete all the frames except the current one. */
 	list_for_each_safe_entry(frame, iter, tmp, &v->frames, node) {
 		if (frame->number != v->current_frame) {
@@ -502,6 +987,11 @@ resize_frame_horizontally(rp_frame *frame, int diff)
 	    (defaults.gap * 2))
 		return;
 
+	if (split_tree(v)) {
+		split_resize(frame, VERTICALLY, diff);
+		return;
+	}
+
 	/* Find out which resize function to use. */
 	if (frame_right(frame) < screen_right(v->screen)) {
 		resize_fn = resize_frame_right;
@@ -545,6 +1035,11 @@ resize_frame_vertically(rp_frame *frame, int diff)
 	    (defaults.gap * 2))
 		return;
 
+	if (split_tree(v)) {
+		split_resize(frame, HORIZONTALLY, diff);
+		return;
+	}
+
 	/* Find out which resize function to use. */
 	if (frame_bottom(frame) < screen_bottom(v->screen)) {
 		resize_fn = resize_frame_bottom;
@@ -652,12 +1147,17 @@ remove_frame(rp_frame *frame)
 	int area;
 	rp_frame *cur;
 	rp_window *win;
+	struct rp_split *grown;
 
 	if (frame == NULL)
 		return;
 
 	v = frame->vscreen;
 
+	/* The frames that shared a split with it take its place. */
+	if ((grown = split_remove(frame)) == NULL)
+		split_tree_invalidate(v);
+
 	area = total_frame_area(v);
 	PRINT_DEBUG(("Total Area: %d\n", area));
 
@@ -671,6 +1171,16 @@ remove_frame(rp_frame *frame)
 			win->sticky_frame = EMPTY;
 	}
 
+	if (grown) {
+		split_maximize_windows(grown, 1);
+		frame_free(v, frame);
+		return;
+	}
+
+	/*
+	 * Without a split tree, try growing each frame into the space that
+	 * was left.
+	 */
 	list_for_each_entry(cur, &v->frames, node) {
 		rp_frame tmp_frame;
 		int fits = 0;
@@ -743,7 +1253,7 @@ remove_frame(rp_frame *frame)
 				rp_window *new =
 				    find_window_number(cur->win_number);
 				maximize_all_windows_in_frame(cur);
-				XRaiseWindow(dpy, new->w);
+				raise_window(new);
 			}
 		} else {
 			memcpy(cur, &tmp_frame, sizeof(rp_frame));
@@ -861,11 +1371,22 @@ blank_frame(rp_frame *frame)
 	set_window_focus(v->screen->key_window);
 }
 
+static void
+frame_indicator_expired(void *arg)
+{
+	hide_frame_indicator();
+}
+
+static struct rp_timer frame_indicator_timer =
+    RP_TIMER_INITIALIZER(frame_indicator_expired, NULL);
+
 void
 hide_frame_indicator(void)
 {
 	rp_screen *cur;
 
+	timer_disarm(&frame_indicator_timer);
+
 	list_for_each_entry(cur, &rp_screens, node) {
 		XUnmapWindow(dpy, cur->frame_window);
 	}
@@ -878,7 +1399,9 @@ show_frame_indicator(int force)
 		hide_frame_indicator();
 		if (defaults.frame_indicator_timeout != -1) {
 			show_frame_message(defaults.frame_fmt);
-			alarm(defaults.frame_indicator_timeout);
+			if (defaults.frame_indicator_timeout > 0)
+				timer_arm(&frame_indicator_timer,
+				    defaults.frame_indicator_timeout * 1000);
 		}
 	}
 }
@@ -943,6 +1466,9 @@ find_frame_up(rp_frame *frame)
 	rp_vscreen *v = frame->vscreen;
 	int wingap = 0, curgap;
 
+	if (split_tree(v))
+		return split_find_frame(frame, HORIZONTALLY, 0);
+
 	list_for_each_entry(cur, &v->frames, node) {
 		if (frame_top(frame) != frame_bottom(cur))
 			continue;
@@ -964,6 +1490,9 @@ find_frame_down(rp_frame *frame)
 	rp_vscreen *v = frame->vscreen;
 	int wingap = 0, curgap;
 
+	if (split_tree(v))
+		return split_find_frame(frame, HORIZONTALLY, 1);
+
 	list_for_each_entry(cur, &v->frames, node) {
 		if (frame_bottom(frame) != frame_top(cur))
 			continue;
@@ -985,6 +1514,9 @@ find_frame_left(rp_frame *frame)
 	rp_vscreen *v = frame->vscreen;
 	int wingap = 0, curgap;
 
+	if (split_tree(v))
+		return split_find_frame(frame, VERTICALLY, 0);
+
 	list_for_each_entry(cur, &v->frames, node) {
 		if (frame_left(frame) != frame_right(cur))
 			continue;
@@ -1006,6 +1538,9 @@ find_frame_right(rp_frame *frame)
 	rp_vscreen *v = frame->vscreen;
 	int wingap = 0, curgap;
 
+	if (split_tree(v))
+		return split_find_frame(frame, VERTICALLY, 1);
+
 	list_for_each_entry(cur, &v->frames, node) {
 		if (frame_right(frame) != frame_left(cur))
 			continue;
@@ -37,6 +37,8 @@ rp_frame *find_frame_next(rp_frame *frame);
 rp_frame *find_frame_prev(rp_frame *frame);
 rp_window *current_window(void);
 void init_frame_list(rp_vscreen *vscreen);
+void split_tree_invalidate(rp_vscreen *v);
+void scale_frames(rp_vscreen *v, int oldwidth, int oldheight);
 void set_active_frame(rp_frame *frame, int force_indicator);
 void exchange_with_frame(rp_frame *cur, rp_frame *frame);
 void blank_frame(rp_frame *frame);
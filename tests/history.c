@@ -0,0 +1,131 @@
+/*
+ * Regression test for the history hash set.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Add more lines than the initial 64 buckets hold, so the bucket array grows
+ * and items are evicted, and look every one of them up again.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sdorfehs.h"
+
+struct rp_defaults defaults;
+
+static char homedir[] = "/tmp/sdorfehs-history.XXXXXX";
+
+const char *
+get_homedir(void)
+{
+	return homedir;
+}
+
+/* Walk the history from newest to oldest, expecting lines last..first. */
+static void
+expect(int id, const char *what, int nexpected, const int *expected)
+{
+	const char *line;
+	char want[32];
+	int n = 0;
+
+	history_reset();
+	while ((line = history_previous(id)) != NULL) {
+		if (n >= nexpected)
+			errx(1, "%s: more than %d lines, next is \"%s\"", what,
+			    nexpected, line);
+		snprintf(want, sizeof(want), "line %d",
+		    expected[nexpected - 1 - n]);
+		if (strcmp(line, want))
+			errx(1, "%s: line %d is \"%s\", expected \"%s\"", what,
+			    n, line, want);
+		n++;
+	}
+	if (n != nexpected)
+		errx(1, "%s: %d lines, expected %d", what, n, nexpected);
+}
+
+static void
+add(int id, int n)
+{
+	char line[32];
+
+	snprintf(line, sizeof(line), "line %d", n);
+	history_add(id, line);
+}
+
+int
+main(void)
+{
+	int expected[300];
+	int i, n;
+
+	if (mkdtemp(homedir) == NULL)
+		err(1, "mkdtemp");
+
+	/* A broken chain loops forever in the lookup. */
+	alarm(10);
+
+	history_load();
+	defaults.history_compaction = 1;
+
+	/* Grow through 64, 128 and 256 buckets. */
+	defaults.history_size = 1000;
+	for (i = 0; i < 300; i++)
+		add(hist_OTHER, i);
+	for (i = 0; i < 300; i++)
+		expected[i] = i;
+	expect(hist_OTHER, "add", 300, expected);
+
+	/* Every line must be found again and moved to the end. */
+	for (i = 0; i < 150; i++)
+		add(hist_OTHER, i);
+	n = 0;
+	for (i = 150; i < 300; i++)
+		expected[n++] = i;
+	for (i = 0; i < 150; i++)
+		expected[n++] = i;
+	expect(hist_OTHER, "compaction", 300, expected);
+
+	/* Evicted lines must leave their buckets. */
+	defaults.history_size = 50;
+	for (i = 0; i < 200; i++)
+		add(hist_SELECT, i);
+	for (i = 0; i < 50; i++)
+		expected[i] = 150 + i;
+	expect(hist_SELECT, "eviction", 50, expected);
+
+	for (i = 0; i < 200; i++)
+		add(hist_SELECT, i);
+	expect(hist_SELECT, "eviction and compaction", 50, expected);
+
+	add(hist_SELECT, 160);
+	for (i = 0, n = 0; i < 50; i++)
+		if (150 + i != 160)
+			expected[n++] = 150 + i;
+	expected[n++] = 160;
+	expect(hist_SELECT, "re-add", 50, expected);
+
+	rmdir(homedir);
+	printf("history: ok\n");
+
+	return 0;
+}
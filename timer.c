@@ -0,0 +1,114 @@
+/*
+ * Timers run from the main loop.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#include <time.h>
+
+#include "sdorfehs.h"
+
+/*
+ * Armed timers, soonest first.  listen_for_events() sleeps no longer than
+ * timers_timeout() and then calls timers_run(), so any number of independent
+ * deadlines can be pending without signals.
+ */
+static LIST_HEAD(rp_timers);
+
+long long
+timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* (Re)start a timer to call its function msec milliseconds from now. */
+void
+timer_arm(struct rp_timer *t, int msec)
+{
+	struct rp_timer *cur;
+
+	timer_disarm(t);
+
+	t->deadline = timer_now() + (msec > 0 ? msec : 0);
+	t->armed = 1;
+
+	list_for_each_entry(cur, &rp_timers, node) {
+		if (cur->deadline > t->deadline)
+			break;
+	}
+	list_add_tail(&t->node, &cur->node);
+}
+
+void
+timer_disarm(struct rp_timer *t)
+{
+	if (!t->armed)
+		return;
+
+	list_del(&t->node);
+	t->armed = 0;
+}
+
+int
+timer_armed(struct rp_timer *t)
+{
+	return t->armed;
+}
+
+/* Milliseconds until the timer fires, or -1 if it isn't armed. */
+int
+timer_left(struct rp_timer *t)
+{
+	long long left;
+
+	if (!t->armed)
+		return -1;
+
+	left = t->deadline - timer_now();
+	return left > 0 ? (int)left : 0;
+}
+
+/* Milliseconds until the next timer fires, -1 if none is armed. */
+int
+timers_timeout(void)
+{
+	struct rp_timer *first;
+
+	list_first(first, &rp_timers, node);
+	if (first == NULL)
+		return -1;
+
+	return timer_left(first);
+}
+
+/* Call the functions of the timers that are due, disarming them first. */
+void
+timers_run(void)
+{
+	struct rp_timer *first;
+	long long now = timer_now();
+
+	for (;;) {
+		list_first(first, &rp_timers, node);
+		if (first == NULL || first->deadline > now)
+			break;
+
+		timer_disarm(first);
+		first->fn(first->arg);
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * Prototypes for timers run from the main loop.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#ifndef _SDORFEHS_TIMER_H
+#define _SDORFEHS_TIMER_H 1
+
+struct rp_timer {
+	/* When the timer fires, in milliseconds of timer_now() */
+	long long deadline;
+	int armed;
+
+	void (*fn)(void *);
+	void *arg;
+
+	struct list_head node;
+};
+
+#define RP_TIMER_INITIALIZER(fn, arg) { 0, 0, (fn), (arg), { NULL, NULL } }
+
+long long timer_now(void);
+void timer_arm(struct rp_timer *t, int msec);
+void timer_disarm(struct rp_timer *t);
+int timer_armed(struct rp_timer *t);
+int timer_left(struct rp_timer *t);
+int timers_timeout(void);
+void timers_run(void);
+
+#endif	/* ! _SDORFEHS_TIMER_H */
@@ -38,3 +38,45 @@ isu8cont(char c)
 {
 	return ((c) & 0xC0) == 0x80;
 }
+
+/*
+ * Decode the UTF-8 sequence at the start of s, which holds len bytes, into
+ * ucs4.  Returns the number of bytes used or -1 for a malformed sequence.
+ */
+int
+utf8_decode(const char *s, int len, unsigned int *ucs4)
+{
+	const unsigned char *u = (const unsigned char *)s;
+	unsigned int c;
+	int i, n;
+
+	if (len < 1)
+		return -1;
+
+	if (u[0] < 0x80) {
+		*ucs4 = u[0];
+		return 1;
+	} else if ((u[0] & 0xE0) == 0xC0) {
+		c = u[0] & 0x1F;
+		n = 2;
+	} else if ((u[0] & 0xF0) == 0xE0) {
+		c = u[0] & 0x0F;
+		n = 3;
+	} else if ((u[0] & 0xF8) == 0xF0) {
+		c = u[0] & 0x07;
+		n = 4;
+	} else
+		return -1;
+
+	if (n > len)
+		return -1;
+
+	for (i = 1; i < n; i++) {
+		if (!isu8cont(u[i]))
+			return -1;
+		c = (c << 6) | (u[i] & 0x3F);
+	}
+
+	*ucs4 = c;
+	return n;
+}
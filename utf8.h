@@ -23,6 +23,7 @@
 extern int isu8char(char c);
 extern int isu8start(char c);
 extern int isu8cont(char c);
+int utf8_decode(const char *s, int len, unsigned int *ucs4);
 
 extern int utf8_locale;
 
@@ -24,13 +24,49 @@ rp_vscreen *vscreen_prev(void);
 
 static int vscreen_access = 1;
 
+/* Record (or forget, when we is NULL) which window elem has number n. */
+static void
+vscreen_set_number_index(rp_vscreen *v, int n, rp_window_elem *we)
+{
+	int i;
+
+	if (n < 0)
+		return;
+
+	if (n >= v->windows_by_number_size) {
+		if (we == NULL)
+			return;
+
+		i = v->windows_by_number_size;
+		v->windows_by_number_size = (n + 1) * 2;
+		v->windows_by_number = xrealloc(v->windows_by_number,
+		    v->windows_by_number_size * sizeof(rp_window_elem *));
+		for (; i < v->windows_by_number_size; i++)
+			v->windows_by_number[i] = NULL;
+	}
+
+	v->windows_by_number[n] = we;
+}
+
+/* Forget the number of a window elem, if it is still indexed by it. */
+static void
+vscreen_clear_number_index(rp_vscreen *v, rp_window_elem *we)
+{
+	if (we->number >= 0 && we->number < v->windows_by_number_size &&
+	    v->windows_by_number[we->number] == we)
+		v->windows_by_number[we->number] = NULL;
+}
+
 void
 init_vscreen(rp_vscreen *v, rp_screen *s)
 {
 	v->screen = s;
 	v->number = numset_request(s->vscreens_numset);
 	v->frames_numset = numset_new();
+	v->split_tree = NULL;
 	v->numset = numset_new();
+	v->windows_by_number = NULL;
+	v->windows_by_number_size = 0;
 	v->last_access = 0;
 
 	if (v->number == 0)
@@ -90,8 +126,14 @@ vscreen_free(rp_vscreen *v)
 	rp_frame *frame;
 	struct list_head *iter, *tmp;
 
+	split_tree_invalidate(v);
+
 	list_for_each_safe_entry(frame, iter, tmp, &v->frames, node)
 		frame_free(v, frame);
+
+	free(v->windows_by_number);
+	v->windows_by_number = NULL;
+	v->windows_by_number_size = 0;
 }
 
 int
@@ -164,6 +206,7 @@ vscreen_copy_frameset(rp_vscreen *v)
 void
 vscreen_restore_frameset(rp_vscreen *v, struct list_head *head)
 {
+	split_tree_invalidate(v);
 	frameset_free(&v->frames);
 	INIT_LIST_HEAD(&v->frames);
 
@@ -313,9 +356,11 @@ vscreen_move_window(rp_vscreen *to, rp_window *w)
 		f->win_number = EMPTY;
 
 	numset_release(from->numset, we->number);
+	vscreen_clear_number_index(from, we);
 	list_del(&we->node);
 
 	we->number = numset_request(to->numset);
+	vscreen_set_number_index(to, we->number, we);
 	vscreen_insert_window(&to->mapped_windows, we);
 
 	if (to == rp_current_vscreen)
@@ -489,15 +534,10 @@ vscreen_find_window(struct list_head *list, rp_window *win)
 rp_window_elem *
 vscreen_find_window_by_number(rp_vscreen *v, int num)
 {
-	rp_window_elem *cur;
-
-	list_for_each_entry(cur, &v->mapped_windows, node) {
-		if (cur->number == num)
-			return cur;
-	}
-
-	return NULL;
+	if (num < 0 || num >= v->windows_by_number_size)
+		return NULL;
 
+	return v->windows_by_number[num];
 }
 
 /*
@@ -547,6 +587,19 @@ vscreen_resort_window(rp_vscreen *v, rp_window_elem *w)
 	vscreen_insert_window(&v->mapped_windows, w);
 }
 
+/*
+ * Give a mapped window_elem a new number, keeping the list sorted. The caller
+ * is responsible for the numset.
+ */
+void
+vscreen_renumber_window(rp_vscreen *v, rp_window_elem *w, int number)
+{
+	vscreen_clear_number_index(v, w);
+	w->number = number;
+	vscreen_set_number_index(v, number, w);
+	vscreen_resort_window(v, w);
+}
+
 void
 vscreen_add_window(rp_vscreen *v, rp_window *w)
 {
@@ -569,6 +622,7 @@ vscreen_map_window(rp_vscreen *v, rp_window *win)
 	we = vscreen_find_window(&v->unmapped_windows, win);
 	if (we) {
 		we->number = numset_request(v->numset);
+		vscreen_set_number_index(v, we->number, we);
 		list_del(&we->node);
 		vscreen_insert_window(&v->mapped_windows, we);
 	}
@@ -582,6 +636,7 @@ vscreen_unmap_window(rp_vscreen *v, rp_window *win)
 	we = vscreen_find_window(&v->mapped_windows, win);
 	if (we) {
 		numset_release(v->numset, we->number);
+		vscreen_clear_number_index(v, we);
 		list_move_tail(&we->node, &v->unmapped_windows);
 	}
 }
@@ -736,9 +791,11 @@ vscreens_merge(rp_vscreen *from, rp_vscreen *to)
 	/* Move the mapped windows. */
 	list_for_each_safe_entry(cur, iter, tmp, &from->mapped_windows, node) {
 		numset_release(from->numset, cur->number);
+		vscreen_clear_number_index(from, cur);
 		list_del(&cur->node);
 
 		cur->number = numset_request(to->numset);
+		vscreen_set_number_index(to, cur->number, cur);
 		vscreen_insert_window(&to->mapped_windows, cur);
 	}
 }
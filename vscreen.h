@@ -40,6 +40,7 @@ void vscreen_move_window(rp_vscreen *v, rp_window *w);
 
 void vscreen_add_window(rp_vscreen *v, rp_window *w);
 void vscreen_resort_window(rp_vscreen *v, rp_window_elem *w);
+void vscreen_renumber_window(rp_vscreen *v, rp_window_elem *w, int number);
 void vscreen_insert_window(struct list_head *h, rp_window_elem *w);
 
 void vscreen_del_window(rp_vscreen *v, rp_window *win);
@@ -28,8 +28,91 @@ LIST_HEAD(rp_mapped_window);
 
 struct numset *rp_window_numset;
 
+/*
+ * Every managed window, mapped or not, hashed by its X window ID so that
+ * event handlers don't have to walk the window lists.
+ */
+#define WINDOW_HASH_SIZE 256
+static rp_window *window_hash[WINDOW_HASH_SIZE];
+
+/* The mapped windows indexed by their number. */
+static rp_window **windows_by_number = NULL;
+static int windows_by_number_size = 0;
+
+/*
+ * Windows whose name changed since the last time the event queue was
+ * drained, and how many name changes were folded into an earlier one.
+ */
+static LIST_HEAD(rp_dirty_window);
+
+/*
+ * The mapped windows in the order they were mapped in, and from bottom to
+ * top.  _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING are rewritten from
+ * these once the event queue has been drained, and only if they changed.
+ */
+static LIST_HEAD(rp_client_list);
+static LIST_HEAD(rp_client_stacking);
+static int nclients = 0;
+static int client_list_changed = 0;
+static int client_stacking_changed = 0;
+static unsigned long name_updates_coalesced = 0;
+
 static void set_active_window_body(rp_window * win, int force);
 
+static unsigned int
+window_hash_key(Window w)
+{
+	return (w ^ (w >> 8) ^ (w >> 16)) % WINDOW_HASH_SIZE;
+}
+
+static void
+window_hash_add(rp_window *win)
+{
+	unsigned int key = window_hash_key(win->w);
+
+	win->hash_next = window_hash[key];
+	window_hash[key] = win;
+}
+
+void
+window_hash_del(rp_window *win)
+{
+	rp_window **cur;
+
+	for (cur = &window_hash[window_hash_key(win->w)]; *cur;
+	    cur = &(*cur)->hash_next) {
+		if (*cur == win) {
+			*cur = win->hash_next;
+			win->hash_next = NULL;
+			return;
+		}
+	}
+}
+
+/* Record (or forget, when win is NULL) which window has number n. */
+void
+window_set_number_index(int n, rp_window *win)
+{
+	int i;
+
+	if (n < 0)
+		return;
+
+	if (n >= windows_by_number_size) {
+		if (win == NULL)
+			return;
+
+		i = windows_by_number_size;
+		windows_by_number_size = (n + 1) * 2;
+		windows_by_number = xrealloc(windows_by_number,
+		    windows_by_number_size * sizeof(rp_window *));
+		for (; i < windows_by_number_size; i++)
+			windows_by_number[i] = NULL;
+	}
+
+	windows_by_number[n] = win;
+}
+
 /* Get the mouse position relative to the the specified window */
 static void
 get_mouse_position(rp_window *win, int *mouse_x, int *mouse_y)
@@ -48,10 +131,15 @@ free_window(rp_window *w)
 	if (w == NULL)
 		return;
 
+	if (!list_empty(&w->dirty_node))
+		list_del(&w->dirty_node);
+	client_list_remove(w);
+
 	free(w->user_name);
 	free(w->res_name);
 	free(w->res_class);
 	free(w->wm_name);
+	free(w->net_wm_state);
 
 	XFree(w->hints);
 
@@ -194,6 +282,13 @@ add_to_window_list(rp_screen *s, Window w)
 	    &new_window->transient_for);
 	PRINT_DEBUG(("transient %d\n", new_window->transient));
 	new_window->full_screen = 0;
+	new_window->cached = 0;
+	new_window->wm_state = WithdrawnState;
+	new_window->window_type = None;
+	new_window->net_wm_state = NULL;
+	new_window->net_wm_state_len = 0;
+	new_window->wm_state_writes = 0;
+	new_window->net_wm_state_writes = 0;
 
 	update_window_gravity(new_window);
 
@@ -208,8 +303,13 @@ add_to_window_list(rp_screen *s, Window w)
 	new_window->res_name = NULL;
 	new_window->res_class = NULL;
 
+	INIT_LIST_HEAD(&new_window->dirty_node);
+	INIT_LIST_HEAD(&new_window->client_node);
+	INIT_LIST_HEAD(&new_window->stacking_node);
+
 	/* Add the window to the end of the unmapped list. */
 	list_add_tail(&new_window->node, &rp_unmapped_window);
+	window_hash_add(new_window);
 
 	child_info = get_child_info(w, 1);
 	if (child_info) {
@@ -246,6 +346,140 @@ add_to_window_list(rp_screen *s, Window w)
 	return new_window;
 }
 
+/*
+ * Note that the name of the window changed. The name is refetched once the
+ * event queue has been drained, so a client updating its title many times in
+ * a row only costs one fetch, one bar redraw and one hook run.
+ */
+void
+mark_window_name_dirty(rp_window *win)
+{
+	if (!list_empty(&win->dirty_node)) {
+		name_updates_coalesced++;
+		return;
+	}
+
+	list_add_tail(&win->dirty_node, &rp_dirty_window);
+}
+
+/* Refetch the names of all windows marked by mark_window_name_dirty. */
+void
+update_dirty_window_names(void)
+{
+	struct list_head *iter, *tmp;
+	rp_screen *s;
+	rp_window *win;
+	LIST_HEAD(changed);
+
+	if (list_empty(&rp_dirty_window))
+		return;
+
+	PRINT_DEBUG(("updating dirty window names, %lu updates coalesced "
+	    "so far\n", name_updates_coalesced));
+
+	list_for_each_entry(s, &rp_screens, node) {
+		list_for_each_safe_entry(win, iter, tmp, &rp_dirty_window,
+		    dirty_node) {
+			if (win->vscreen->screen != s)
+				continue;
+
+			if (update_window_name(win))
+				list_move_tail(&win->dirty_node, &changed);
+			else
+				list_del_init(&win->dirty_node);
+		}
+
+		if (list_empty(&changed))
+			continue;
+
+		update_window_names(s, defaults.window_fmt);
+		list_for_each_safe_entry(win, iter, tmp, &changed,
+		    dirty_node) {
+			list_del_init(&win->dirty_node);
+			hook_run_window(&rp_title_changed_hook, win);
+		}
+	}
+
+	/* Windows on a screen that went away have nothing left to update. */
+	list_for_each_safe_entry(win, iter, tmp, &rp_dirty_window, dirty_node)
+		list_del_init(&win->dirty_node);
+}
+
+/* Add the window to the client lists, on top of the stacking order. */
+void
+client_list_add(rp_window *win)
+{
+	if (!list_empty(&win->client_node))
+		return;
+
+	list_add_tail(&win->client_node, &rp_client_list);
+	list_add_tail(&win->stacking_node, &rp_client_stacking);
+	nclients++;
+	client_list_changed = 1;
+	client_stacking_changed = 1;
+}
+
+void
+client_list_remove(rp_window *win)
+{
+	if (list_empty(&win->client_node))
+		return;
+
+	list_del_init(&win->client_node);
+	list_del_init(&win->stacking_node);
+	nclients--;
+	client_list_changed = 1;
+	client_stacking_changed = 1;
+}
+
+/* Raise the window and move it to the top of the stacking order. */
+void
+raise_window(rp_window *win)
+{
+	XRaiseWindow(dpy, win->w);
+
+	if (list_empty(&win->stacking_node) ||
+	    win->stacking_node.next == &rp_client_stacking)
+		return;
+
+	list_move_tail(&win->stacking_node, &rp_client_stacking);
+	client_stacking_changed = 1;
+}
+
+/* Publish the client lists on the root window if they changed. */
+void
+update_client_lists(void)
+{
+	unsigned long *wins;
+	rp_window *win;
+	int i;
+
+	if (!client_list_changed && !client_stacking_changed)
+		return;
+
+	wins = xmalloc(sizeof(unsigned long) * (nclients ? nclients : 1));
+
+	if (client_list_changed) {
+		i = 0;
+		list_for_each_entry(win, &rp_client_list, client_node)
+			wins[i++] = win->w;
+		set_atom(rp_glob_screen.root, _net_client_list, XA_WINDOW,
+		    wins, nclients);
+	}
+
+	if (client_stacking_changed) {
+		i = 0;
+		list_for_each_entry(win, &rp_client_stacking, stacking_node)
+			wins[i++] = win->w;
+		set_atom(rp_glob_screen.root, _net_client_list_stacking,
+		    XA_WINDOW, wins, nclients);
+	}
+
+	free(wins);
+	client_list_changed = 0;
+	client_stacking_changed = 0;
+}
+
 /* Check to see if the window is in the list of windows. */
 rp_window *
 find_window_in_list(Window w, struct list_head *list)
@@ -264,36 +498,43 @@ find_window_in_list(Window w, struct list_head *list)
 rp_window *
 find_window(Window w)
 {
-	rp_window *win = NULL;
+	rp_window *win;
 
-	win = find_window_in_list(w, &rp_mapped_window);
+	for (win = window_hash[window_hash_key(w)]; win; win = win->hash_next) {
+		if (win->w == w)
+			break;
+	}
 
-	if (!win) {
-		win = find_window_in_list(w, &rp_unmapped_window);
-		if (win)
-			PRINT_DEBUG(("Window found in unmapped window list\n"));
-		else
-			PRINT_DEBUG(("Window not found.\n"));
-	} else {
+	if (!win)
+		PRINT_DEBUG(("Window not found.\n"));
+	else if (win->number == -1)
+		PRINT_DEBUG(("Window found in unmapped window list\n"));
+	else
 		PRINT_DEBUG(("Window found in mapped window list.\n"));
-	}
 
 	return win;
 }
 
+/* Like find_window, but only return mapped windows. */
 rp_window *
-find_window_number(int n)
+find_mapped_window(Window w)
 {
-	rp_window *cur;
+	rp_window *win;
 
-	list_for_each_entry(cur, &rp_mapped_window, node) {
-		/* if (cur->state == STATE_UNMAPPED) continue; */
+	win = find_window(w);
+	if (win && win->number == -1)
+		return NULL;
 
-		if (n == cur->number)
-			return cur;
-	}
+	return win;
+}
 
-	return NULL;
+rp_window *
+find_window_number(int n)
+{
+	if (n < 0 || n >= windows_by_number_size)
+		return NULL;
+
+	return windows_by_number[n];
 }
 
 rp_window *
@@ -411,8 +652,6 @@ give_window_focus(rp_window *win, rp_window *last_win)
 	set_rp_window_focus(win);
 
 	raise_utility_windows();
-
-	XSync(dpy, False);
 }
 
 /* In the current frame, set the active window to win. win will have focus. */
@@ -508,7 +747,8 @@ set_active_window_body(rp_window *win, int force)
 		/* Make sure the program bar is always on the top */
 		update_window_names(win->vscreen->screen, defaults.window_fmt);
 
-	XSync(dpy, False);
+	/* Let hooks see the new state, without waiting for the server. */
+	XFlush(dpy);
 
 	/* If we switched frame, go back to the old one. */
 	if (win->vscreen == rp_current_vscreen) {
@@ -630,17 +870,24 @@ free_window_stuff(void)
 
 	list_for_each_safe_entry(cur, iter, tmp, &rp_unmapped_window, node) {
 		list_del(&cur->node);
+		window_hash_del(cur);
 		vscreen_del_window(cur->vscreen, cur);
 		free_window(cur);
 	}
 
 	list_for_each_safe_entry(cur, iter, tmp, &rp_mapped_window, node) {
 		list_del(&cur->node);
+		window_hash_del(cur);
+		window_set_number_index(cur->number, NULL);
 		vscreen_unmap_window(cur->vscreen, cur);
 		vscreen_del_window(cur->vscreen, cur);
 		free_window(cur);
 	}
 
+	free(windows_by_number);
+	windows_by_number = NULL;
+	windows_by_number_size = 0;
+
 	numset_free(rp_window_numset);
 }
 
@@ -677,8 +924,7 @@ window_full_screen(rp_window *win)
 		    "full-screen\n", oldfs->w));
 
 		oldfs->full_screen = 0;
-		remove_atom(oldfs->w, _net_wm_state, XA_ATOM,
-		    _net_wm_state_fullscreen);
+		remove_net_wm_state(oldfs, _net_wm_state_fullscreen);
 		maximize(oldfs);
 	}
 
@@ -694,7 +940,6 @@ window_full_screen(rp_window *win)
 
 	rp_current_screen->full_screen_win = win;
 	win->full_screen = 1;
-	set_atom(win->w, _net_wm_state, XA_ATOM,
-	    &_net_wm_state_fullscreen, 1);
+	set_net_wm_state(win, &_net_wm_state_fullscreen, 1);
 	maximize(win);
 }
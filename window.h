@@ -27,6 +27,15 @@ rp_window *add_to_window_list(rp_screen *s, Window w);
 void last_window(void);
 rp_window *find_window_in_list(Window w, struct list_head *list);
 rp_window *find_window(Window w);
+rp_window *find_mapped_window(Window w);
+void window_hash_del(rp_window *win);
+void window_set_number_index(int n, rp_window *win);
+void mark_window_name_dirty(rp_window *win);
+void update_dirty_window_names(void);
+void client_list_add(rp_window *win);
+void client_list_remove(rp_window *win);
+void raise_window(rp_window *win);
+void update_client_lists(void);
 void maximize_current_window(void);
 void give_window_focus(rp_window *win, rp_window *last_win);
 void set_active_window(rp_window *win);